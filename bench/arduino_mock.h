@@ -0,0 +1,37 @@
+// Minimal stand-in for the parts of the Arduino core used by exec_every.h, so that the library
+// can be compiled and benchmarked on the host.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+class Print;
+
+class Printable {
+public:
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+  virtual size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+  virtual size_t write(uint8_t const *b, size_t n) { size_t k = 0; while (n--) k += write(*b++); return k; }
+  size_t print(char const *s)          { size_t n = 0; while (*s) n += write(static_cast<uint8_t>(*s++)); return n; }
+  size_t print(char c)                 { return write(static_cast<uint8_t>(c)); }
+  size_t print(int v)                  { return print(static_cast<long>(v)); }
+  size_t print(unsigned v)             { return print(static_cast<unsigned long>(v)); }
+  size_t print(long v)                 { char b[24]; snprintf(b, sizeof b, "%ld", v); return print(b); }
+  size_t print(unsigned long v)        { char b[24]; snprintf(b, sizeof b, "%lu", v); return print(b); }
+  size_t print(double v, int d = 2)    { char b[32]; snprintf(b, sizeof b, "%.*f", d, v); return print(b); }
+  size_t print(Printable const &p)     { return p.printTo(*this); }
+  template <typename T> size_t println(T const &v) { size_t n = print(v); return n + print("\r\n"); }
+};
+
+// Mock clocks: advanced explicitly by the benchmark.
+namespace mock {
+  extern volatile uint32_t ms;
+  extern volatile uint32_t us;
+}
+inline uint32_t millis() { return mock::ms; }
+inline uint32_t micros() { return mock::us; }
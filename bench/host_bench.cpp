@@ -0,0 +1,110 @@
+// Host-side benchmark: measures the cost of a call-site check (in ns) for the different macro
+// families, at different numbers of call sites per pass. The clock is mocked and advances by one
+// millisecond per pass, so every call site fires once per 1000 passes.
+//
+// Build and run from this directory:
+//   g++ -O2 -std=gnu++11 -include arduino_mock.h host_bench.cpp -o host_bench && ./host_bench
+// With -DEXEC_EVERY_STATS -DEXEC_EVERY_REGISTRY, a telemetry snapshot of all call sites is
+// written and checked at the end.
+
+#include <chrono>
+#include "../exec_every.h"
+
+namespace mock {
+  volatile uint32_t ms = 0;
+  volatile uint32_t us = 0;
+}
+
+static volatile uint32_t sink = 0;
+
+// x is the name of a function-like macro, so its expansion (which contains commas) is only
+// produced after REPn has been expanded.
+#define REP1(x)   x()
+#define REP10(x)  x() x() x() x() x() x() x() x() x() x()
+#define REP40(x)  REP10(x) REP10(x) REP10(x) REP10(x)
+#define REP50(x)  REP40(x) REP10(x)
+#define REP150(x) REP50(x) REP50(x) REP50(x)
+
+#define SITE_every()      exec_every(1000, [] { sink = sink + 1; });
+#define SITE_every_if()   exec_every_if(1000, (sink & 1) == 0, [] { sink = sink + 1; });
+#define SITE_throttled()  exec_throttled(1000, (sink & 1) == 0, [] { sink = sink + 1; });
+#define SITE_every_lite() exec_every_lite(1000, [] { sink = sink + 1; });
+#define SITE_every16()    exec_every16(1000, [] { sink = sink + 1; });
+#define SITE_every_ct()   exec_every_ct(1000, [] { sink = sink + 1; });
+
+#define DEFINE_PASS(kind, n) static void pass_##kind##_##n() { REP##n(SITE_##kind) }
+#define DEFINE_KIND(kind) DEFINE_PASS(kind, 1) DEFINE_PASS(kind, 10) DEFINE_PASS(kind, 40) DEFINE_PASS(kind, 150)
+
+DEFINE_KIND(every)
+DEFINE_KIND(every_if)
+DEFINE_KIND(throttled)
+DEFINE_KIND(every_lite)
+DEFINE_KIND(every16)
+DEFINE_KIND(every_ct)
+
+// Same as pass_every_*, but with a single clock snapshot per pass.
+#define DEFINE_TICK_PASS(n) static void pass_every_tick_##n() { exec::tick(); REP##n(SITE_every) }
+DEFINE_TICK_PASS(1) DEFINE_TICK_PASS(10) DEFINE_TICK_PASS(40) DEFINE_TICK_PASS(150)
+
+static double measure(void (*pass)(), unsigned sites) {
+  uint32_t const passes = 2000000 / sites;
+  for (uint32_t i = 0; i != 1000; ++i) { mock::ms = mock::ms + 1; pass(); } // warm-up, constructs handles
+  auto const start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i != passes; ++i) { mock::ms = mock::ms + 1; pass(); }
+  auto const stop = std::chrono::steady_clock::now();
+  exec::release();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / (double(passes) * sites);
+}
+
+#if defined(EXEC_EVERY_STATS) && defined(EXEC_EVERY_REGISTRY)
+// Counts the bytes written to it, and the records whose runs are non-zero.
+struct TelemetrySink: public Print {
+  size_t bytes = 0;
+  uint8_t record[exec::TelemetryWriter::recordSize];
+  unsigned fired = 0;
+
+  virtual size_t write(uint8_t c) override {
+    if (bytes >= exec::TelemetryWriter::headerSize) {
+      size_t const i = (bytes - exec::TelemetryWriter::headerSize) % sizeof record;
+      record[i] = c;
+      if (i == sizeof record - 1 && (record[4] | record[5] | record[6] | record[7])) ++fired;
+    }
+    ++bytes;
+    return 1;
+  }
+  using Print::write;
+};
+
+static bool checkTelemetry() {
+  unsigned sites = 0;
+  exec::forEachHandle([&](exec::Handle) { ++sites; });
+  TelemetrySink sink;
+  exec::writeTelemetry(sink);
+  printf("\ntelemetry: %u call sites, %u fired, %u bytes\n", sites, sink.fired, unsigned(sink.bytes));
+  return sink.bytes == exec::TelemetryWriter::headerSize + sites * exec::TelemetryWriter::recordSize &&
+    sink.fired != 0;
+}
+#else
+static bool checkTelemetry() { return true; }
+#endif
+
+#define ROW(kind) { #kind, { pass_##kind##_1, pass_##kind##_10, pass_##kind##_40, pass_##kind##_150 } }
+
+int main() {
+  struct { char const *name; void (*passes[4])(); } const rows[] = {
+    ROW(every), ROW(every_tick), ROW(every_if), ROW(throttled), ROW(every_lite), ROW(every16), ROW(every_ct)
+  };
+  unsigned const sites[4] = { 1, 10, 40, 150 };
+
+  printf("ns per call-site check\n\n");
+  printf("| %-12s |", "sites");
+  for (unsigned n: sites) printf(" %7u |", n);
+  printf("\n|--------------|---------|---------|---------|---------|\n");
+  for (auto const &row: rows) {
+    printf("| %-12s |", row.name);
+    for (unsigned i = 0; i != 4; ++i) printf(" %7.2f |", measure(row.passes[i], sites[i]));
+    printf("\n");
+  }
+  if (!checkTelemetry()) return 1;
+  return sink == 0xdeadbeef;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Compiles size/size.ino on the host (g++ -Os, against arduino_mock.h) with 0 and 40 call sites
+# of each macro family and prints the code and data size per call site. Useful for comparing
+# changes when no cross-compiler is at hand; absolute numbers differ from the target's.
+#
+# Usage: ./host_size.sh [extra compiler flags...]
+
+set -e
+cd "$(dirname "$0")"
+REPO="$(cd .. && pwd)"
+CXX="${CXX:-g++}"
+KINDS="every every_if throttled every_lite every16 every_ct"
+FLAGS="$*"
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+# Prints "<text> <data+bss>" for the given kind and number of call sites.
+measure() {
+  "$CXX" -std=gnu++11 -Os -c -x c++ -include arduino_mock.h -I"$REPO" -DKIND="$1" -DSITES="$2" $FLAGS \
+    size/size.ino -o "$TMP/size.o"
+  size -A "$TMP/size.o" | awk '/^\.text/ { text += $2 } /^\.(data|bss)/ { data += $2 } END { print text + 0, data + 0 }'
+}
+
+echo "| kind       |  code |  data |"
+echo "|------------|-------|-------|"
+for kind in $KINDS; do
+  set -- $(measure "$kind" 0)
+  text0=$1; data0=$2
+  set -- $(measure "$kind" 40)
+  printf "| %-10s | %5s | %5s |\n" "$kind" \
+    "$(awk "BEGIN { printf \"%.1f\", ($1 - $text0) / 40 }")" \
+    "$(awk "BEGIN { printf \"%.1f\", ($2 - $data0) / 40 }")"
+done
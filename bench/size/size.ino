@@ -0,0 +1,35 @@
+// Reference sketch for measuring the flash/SRAM cost of call sites; see ../size_table.sh.
+// SITES (0, 1, 10 or 40) call sites of kind KIND are placed in loop().
+
+#include <exec_every.h>
+
+#ifndef SITES
+#define SITES 0
+#endif
+
+#ifndef KIND
+#define KIND every
+#endif
+
+volatile uint32_t sink;
+
+#define SITE_every()      exec_every(1000, [] { sink = sink + 1; });
+#define SITE_every_if()   exec_every_if(1000, (sink & 1) == 0, [] { sink = sink + 1; });
+#define SITE_throttled()  exec_throttled(1000, (sink & 1) == 0, [] { sink = sink + 1; });
+#define SITE_every_lite() exec_every_lite(1000, [] { sink = sink + 1; });
+#define SITE_every16()    exec_every16(1000, [] { sink = sink + 1; });
+#define SITE_every_ct()   exec_every_ct(1000, [] { sink = sink + 1; });
+
+#define REP0(x)
+#define REP1(x)   x()
+#define REP10(x)  x() x() x() x() x() x() x() x() x() x()
+#define REP40(x)  REP10(x) REP10(x) REP10(x) REP10(x)
+
+#define SITES_OF_(kind, n) REP##n(SITE_##kind)
+#define SITES_OF(kind, n) SITES_OF_(kind, n)
+
+void setup() {}
+
+void loop() {
+  SITES_OF(KIND, SITES)
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Cross-compiles size/size.ino with arduino-cli for a set of boards and prints the flash and SRAM
+# cost per call site for each macro family, computed as (size(40 sites) - size(0 sites)) / 40.
+#
+# Usage: ./size_table.sh [fqbn...]
+# Requires arduino-cli with the corresponding cores installed. Set EXTRA_FLAGS_PROPERTY if a core
+# does not support compiler.cpp.extra_flags.
+
+set -e
+cd "$(dirname "$0")"
+REPO="$(cd .. && pwd)"
+PROPERTY="${EXTRA_FLAGS_PROPERTY:-compiler.cpp.extra_flags}"
+KINDS="every every_if throttled every_lite every16 every_ct"
+
+if [ $# -eq 0 ]; then
+  set -- arduino:avr:uno arduino:samd:mkrzero rp2040:rp2040:rpipico esp32:esp32:esp32
+fi
+
+# Prints "<flash> <sram>" for the given fqbn, kind and number of call sites.
+measure() {
+  out="$(arduino-cli compile --fqbn "$1" --library "$REPO" \
+        --build-property "$PROPERTY=-DKIND=$2 -DSITES=$3" size 2>&1)" || { echo "$out" >&2; exit 1; }
+  flash="$(echo "$out" | sed -n 's/^Sketch uses \([0-9]*\) bytes.*/\1/p')"
+  sram="$(echo "$out" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')"
+  echo "${flash:-0} ${sram:-0}"
+}
+
+for fqbn in "$@"; do
+  echo
+  echo "$fqbn (bytes per call site)"
+  echo
+  echo "| kind       | flash | SRAM |"
+  echo "|------------|-------|------|"
+  for kind in $KINDS; do
+    set -- $(measure "$fqbn" "$kind" 0)
+    flash0=$1; sram0=$2
+    set -- $(measure "$fqbn" "$kind" 40)
+    printf "| %-10s | %5s | %4s |\n" "$kind" \
+      "$(awk "BEGIN { printf \"%.1f\", ($1 - $flash0) / 40 }")" \
+      "$(awk "BEGIN { printf \"%.1f\", ($2 - $sram0) / 40 }")"
+  done
+done
@@ -1,12 +1,58 @@
 #pragma once
 #include <new>
 
+#if defined(__GNUC__)
+#  define EXEC_EVERY_NOINLINE __attribute__((noinline))
+#else
+#  define EXEC_EVERY_NOINLINE
+#endif
+
+// Coroutine tasks (exec_task) need C++20; the protothread tasks (exec_task_pt) work everywhere.
+#if defined(__has_include)
+#  if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#    include <coroutine>
+#    define EXEC_EVERY_COROUTINES
+#  endif
+#endif
+
+// Multicore mode (ESP32, RP2040): timer updates become atomic, and snapshots and deadlines are 
+// kept per core. EXEC_EVERY_CORE_ID() must return the index of the calling core.
+#ifdef EXEC_EVERY_MULTICORE
+#  ifndef EXEC_EVERY_CORES
+#    define EXEC_EVERY_CORES 2
+#  endif
+#  ifndef EXEC_EVERY_CORE_ID
+#    if defined(ESP32)
+#      define EXEC_EVERY_CORE_ID() xPortGetCoreID()
+#    elif defined(ARDUINO_ARCH_RP2040)
+#      define EXEC_EVERY_CORE_ID() get_core_num()
+#    else
+#      error "EXEC_EVERY_MULTICORE: define EXEC_EVERY_CORE_ID() for this platform"
+#    endif
+#  endif
+#else
+#  undef  EXEC_EVERY_CORES
+#  define EXEC_EVERY_CORES 1
+#  undef  EXEC_EVERY_CORE_ID
+#  define EXEC_EVERY_CORE_ID() 0
+#endif
+
+// Registers read by the clock backends in exec::clocks.
+#if defined(ARDUINO_ARCH_RP2040)
+#  include <hardware/structs/timer.h>
+#endif
+#if defined(__AVR__)
+extern volatile unsigned long timer0_overflow_count;
+#endif
+
 namespace exec {
   namespace detail {
     template <typename T>                       struct IsRvalueReference           { enum { value = 0 }; };
     template <typename T>                       struct IsRvalueReference<T&&>      { enum { value = 1 }; };
     template <typename T>                       struct IsReference                 { enum { value = 0 }; };
     template <typename T>                       struct IsReference<T&>             { enum { value = 1 }; };
+    template <typename T, typename U>           struct IsSame                      { enum { value = 0 }; };
+    template <typename T>                       struct IsSame<T, T>                { enum { value = 1 }; };
     template <typename T>                       struct RemoveReference_            { using type = T;     };
     template <typename T>                       struct RemoveReference_<T&>        { using type = T;     };
     template <typename T>                       struct RemoveReference_<T&&>       { using type = T;     };
@@ -18,6 +64,7 @@ namespace exec {
     template <typename T1, typename T2>         struct Conditional_<false, T1, T2> { using type = T2;    };
     template <bool B, typename T = void>        struct EnableIf_                   {                     };
     template <typename T>                       struct EnableIf_<true, T>          { using type = T;     };
+    template <typename T>                       struct Identity_                   { using type = T;     };
     template <typename T> struct DecayFunction_                                    { using type = T;                  };
     template <typename T, typename... Args> struct DecayFunction_<T(Args...)>      { using type = T(*)(Args...);      };
     template <typename T, typename... Args> struct DecayFunction_<T(Args..., ...)> { using type = T(*)(Args..., ...); };
@@ -30,6 +77,7 @@ namespace exec {
     template <bool B, typename T = void> using EnableIf = typename EnableIf_<B, T>::type;
     template <bool B, typename T1, typename T2> using Conditional = typename Conditional_<B, T1, T2>::type;
     template <typename T> using DecayFunction = typename DecayFunction_<T>::type;
+    template <typename T> using Identity = typename Identity_<T>::type;
     
     template <typename T> T&& declval();
 
@@ -66,78 +114,397 @@ namespace exec {
     };
 
     template <typename Base> struct MaybePrintable<Base, false> {};
+  } // namespace detail
+
+#ifdef EXEC_EVERY_STATS
+  // Execution statistics of a single call site. Durations are measured in microseconds; jitter
+  // is the difference between the actual time elapsed (dt) and the requested interval. A plain
+  // struct (no Printable base, whose virtual destructor would make every handle non-trivially
+  // destructible on some cores); print it with exec::print().
+  struct Stats {
+    uint32_t site = 0;  // id of the call site (see detail::fileId()), 0 for TaskPool slots
+    uint32_t runs = 0;
+    uint32_t skipped = 0;
+    uint32_t minDuration = 0xffffffff;
+    uint32_t maxDuration = 0;
+    uint64_t totalDuration = 0;
+    int32_t minJitter = 0x7fffffff;
+    int32_t maxJitter = -0x7fffffff - 1;
+
+    uint32_t meanDuration() const { 
+      return runs ? static_cast<uint32_t>(totalDuration / runs) : 0; 
+    }
+
+    void record(uint32_t const dt, uint32_t const interval, uint32_t const duration) {
+      ++runs;
+      totalDuration += duration;
+      if (duration < minDuration) minDuration = duration;
+      if (duration > maxDuration) maxDuration = duration;
+      int32_t const jitter = static_cast<int32_t>(dt - interval);
+      if (jitter < minJitter) minJitter = jitter;
+      if (jitter > maxJitter) maxJitter = jitter;
+    }
+
+  };
+
+  inline size_t print(Print &p, Stats const &s) {
+    size_t n = 0;
+    n += p.print("runs=");     n += p.print(s.runs);
+    n += p.print(" skipped="); n += p.print(s.skipped);
+    if (s.runs == 0) return n;
+    n += p.print(" us(min/mean/max)=");
+    n += p.print(s.minDuration); n += p.print('/');
+    n += p.print(s.meanDuration()); n += p.print('/');
+    n += p.print(s.maxDuration);
+    n += p.print(" jitter(min/max)=");
+    n += p.print(s.minJitter); n += p.print('/');
+    n += p.print(s.maxJitter);
+    return n;
+  }
+
+#endif
+
+#ifdef EXEC_EVERY_PROFILE
+  // Whole-loop profiler, fed by tick(). Keeps a histogram of loop periods (time between two
+  // calls to tick()), the time spent inside callbacks and the number of call sites polled. 
+  // Bin i counts periods shorter than 2^(i + BinShift) us; the last bin counts all longer ones.
+  class LoopProfiler: public Printable {
+  public:
+    static constexpr uint8_t Bins = 16;
+    static constexpr uint8_t BinShift = 6;
+
+    uint32_t histogram[Bins] = {};
+    uint32_t passes = 0;
+    uint32_t polls = 0;
+    uint64_t totalTime = 0;
+    uint64_t busyTime = 0;
+    uint32_t pollCost = 0; // ns per poll, set by calibrate()
+
+    // Called from tick() with the current time in microseconds.
+    void pass(uint32_t const now) {
+      if (started) {
+        uint32_t const period = now - last;
+        uint8_t bin = 0;
+        while (bin < Bins - 1 && (period >> (bin + BinShift)) != 0) ++bin;
+        ++histogram[bin];
+        ++passes;
+        totalTime += period;
+      }
+      started = true;
+      last = now;
+    }
+
+    void busy(uint32_t const duration) { busyTime += duration; }
+    void poll() { ++polls; }
+
+    // Measure the cost of polling a call site that does not fire, to estimate the polling
+    // overhead from the number of polls. Best called from setup().
+    void calibrate();
+
+    void clear() {
+      for (uint8_t i = 0; i != Bins; ++i) histogram[i] = 0;
+      passes = polls = 0;
+      totalTime = busyTime = 0;
+      started = false;
+    }
+
+    // Percentage of the measured time spent inside callbacks.
+    uint8_t utilization() const { 
+      return totalTime ? static_cast<uint8_t>(busyTime * 100 / totalTime) : 0; 
+    }
+
+    // Estimated percentage of the measured time spent polling call sites (requires calibrate()).
+    uint8_t overhead() const {
+      return totalTime ? static_cast<uint8_t>((static_cast<uint64_t>(polls) * pollCost / 1000) * 100 / totalTime) : 0;
+    }
+
+    virtual size_t printTo(Print &p) const override {
+      size_t n = 0;
+      n += p.print("passes="); n += p.print(passes);
+      n += p.print(" callbacks="); n += p.print(utilization()); n += p.print('%');
+      if (pollCost) { n += p.print(" polling="); n += p.print(overhead()); n += p.print('%'); }
+      n += p.print("\r\n");
+      for (uint8_t i = 0; i != Bins; ++i) {
+        if (histogram[i] == 0) continue;
+        n += p.print(i == Bins - 1 ? ">=" : "<");
+        n += p.print(static_cast<uint32_t>(1) << (i == Bins - 1 ? i - 1 + BinShift : i + BinShift));
+        n += p.print("us: "); n += p.print(histogram[i]);
+        n += p.print("\r\n");
+      }
+      return n;
+    }
+
+  private:
+    uint32_t last = 0;
+    bool started = false;
+  };
+
+  namespace detail {
+    template <typename = void>
+    struct Profiler {
+      static LoopProfiler instance;
+    };
+    template <typename T> LoopProfiler Profiler<T>::instance;
+  }
+
+  inline LoopProfiler &loopProfiler() { return detail::Profiler<>::instance; }
+#endif
+
+#if defined(EXEC_EVERY_PROFILE) && !defined(EXEC_EVERY_STATS)
+  struct Stats;
+#endif
+
+#if defined(EXEC_EVERY_STATS) || defined(EXEC_EVERY_PROFILE)
+  namespace detail {
+    // Measures the duration of a callback and records it on destruction, i.e. after the result
+    // has been moved into the returned value.
+    class RunTiming {
+#ifdef EXEC_EVERY_STATS
+      Stats *stats;
+      uint32_t const dt;
+      uint32_t const interval;
+#endif
+      uint32_t const start;
+    public:
+      RunTiming(Stats *stats, uint32_t dt, uint32_t interval): 
+#ifdef EXEC_EVERY_STATS
+        stats(stats), dt(dt), interval(interval), 
+#endif
+        start(::micros()) {
+#ifndef EXEC_EVERY_STATS
+        (void)stats; (void)dt; (void)interval;
+#endif
+      }
+
+      ~RunTiming() { 
+        uint32_t const duration = ::micros() - start;
+#ifdef EXEC_EVERY_STATS
+        if (stats) stats->record(dt, interval, duration);
+#endif
+#ifdef EXEC_EVERY_PROFILE
+        loopProfiler().busy(duration);
+#endif
+      }
+    };
+  } // namespace detail
+#endif
+
+  namespace detail {
+    // Handles do not use virtual functions. Instead, each call site provides a single thunk that
+    // knows the concrete handle type and dispatches the requested operation. This costs one
+    // function pointer per handle (the size of a vptr) but no vtables.
+    enum class Op: uint8_t { Reset, Exec, Run, Save, Restore };
+
+    class HandleBase;
+    using Thunk = void(*)(HandleBase*, Op, void*, uint32_t);
+
+#ifdef EXEC_EVERY_REGISTRY
+    // All handles link themselves into a single static list on construction (no allocation).
+    template <typename = void>
+    struct Registry {
+      static HandleBase *head;
+    };
+    template <typename T> HandleBase *Registry<T>::head = nullptr;
+
+    // Elapsed time of a call site saved by saveHandles(). Call sites are identified by the
+    // address of their handle, which is the same after a reset as long as the firmware is.
+    struct SavedHandle {
+      uint32_t key;
+      uint32_t elapsed;
+    };
+
+    inline uint32_t key(HandleBase const *h) { return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(h)); }
+
+    // State passed to restoreHandles(), consulted whenever a handle is started.
+    template <typename = void>
+    struct Saved {
+      static SavedHandle const *entries;
+      static uint16_t count;
+      static uint32_t slept;
+    };
+    template <typename T> SavedHandle const *Saved<T>::entries = nullptr;
+    template <typename T> uint16_t Saved<T>::count = 0;
+    template <typename T> uint32_t Saved<T>::slept = 0;
+
+    inline SavedHandle const *saved(HandleBase const *h) {
+      for (uint16_t i = 0; i != Saved<>::count; ++i)
+        if (Saved<>::entries[i].key == key(h)) return &Saved<>::entries[i];
+      return nullptr;
+    }
+#endif
 
+    // A handle is either started on construction, or constant-initialized (thunk == nullptr, no
+    // guard needed for the static) and started on first use.
     class HandleBase {
-      friend void reset(HandleBase*);
-      virtual void reset() = 0;
+      Thunk thunk;
+#ifdef EXEC_EVERY_STATS
+    public:
+      Stats stats;
+    private:
+#endif
+#ifdef EXEC_EVERY_REGISTRY
+      HandleBase *nextHandle = nullptr;
+
+      void link() {
+#ifdef EXEC_EVERY_MULTICORE
+        nextHandle = __atomic_load_n(&Registry<>::head, __ATOMIC_ACQUIRE);
+        while (!__atomic_compare_exchange_n(&Registry<>::head, &nextHandle, this, true, 
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {}
+#else
+        nextHandle = Registry<>::head; 
+        Registry<>::head = this;
+#endif
+      }
+    public:
+      HandleBase *next() const { return nextHandle; }
+#else
+      void link() {}
+#endif
+    protected:
+      constexpr HandleBase(): thunk(nullptr) {}
+      HandleBase(Thunk thunk): thunk(thunk) { link(); }
+
+      void start(Thunk t) {
+        link();
+#ifdef EXEC_EVERY_MULTICORE
+        __atomic_store_n(&thunk, t, __ATOMIC_RELEASE);
+#else
+        thunk = t;
+#endif
+      }
+
+#ifdef EXEC_EVERY_MULTICORE
+      static void busy(HandleBase*, Op, void*, uint32_t) {}
+
+      bool started(Thunk t) const { return __atomic_load_n(&thunk, __ATOMIC_ACQUIRE) == t; }
+
+      // Claim the start of a constant-initialized handle: true for exactly one core; the others 
+      // wait until it has been started.
+      bool claim() {
+        Thunk expected = nullptr;
+        if (__atomic_compare_exchange_n(&thunk, &expected, &busy, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) 
+          return true;
+        while (__atomic_load_n(&thunk, __ATOMIC_ACQUIRE) == &busy) {}
+        return false;
+      }
+#else
+      bool started(Thunk) const { return thunk != nullptr; }
+      bool claim() { return true; }
+#endif
+    public:
+      void dispatch(Op op, void *out = nullptr, uint32_t dt = 0) { thunk(this, op, out, dt); }
     };
-    inline void reset(HandleBase *h) { if (h) h->reset(); }
+    inline void reset(HandleBase *h) { if (h) h->dispatch(Op::Reset); }
     struct MaybeFactory;
+
+    // Every call site is tagged with its __COUNTER__ value (Tag, unique within the translation 
+    // unit, which keeps the statics of different call sites apart) and the FNV-1a hash of the base
+    // name of its source file (File). Their xor is the site's telemetry id: it does not depend on 
+    // paths, link order or addresses. The separator is searched for by bisection so that the 
+    // recursion depth does not grow with the length of the path.
+    constexpr uint32_t fnv1a(char const *s, uint32_t const h = 2166136261u) {
+      return *s ? fnv1a(s + 1, (h ^ static_cast<uint8_t>(*s)) * 16777619u) : h;
+    }
+    constexpr size_t baseStart(char const *s, size_t const from, size_t const to) {
+      return to - from == 1 ? (s[from] == '/' || s[from] == '\\' ? to : 0)
+           : baseStart(s, from + (to - from) / 2, to) ? baseStart(s, from + (to - from) / 2, to)
+           : baseStart(s, from, from + (to - from) / 2);
+    }
+    constexpr uint32_t fileId(char const *file, size_t const length) {
+      return fnv1a(file + (length ? baseStart(file, 0, length) : 0));
+    }
+
+    template <int Tag, uint32_t File>
+    inline void identify(HandleBase &h) {
+#ifdef EXEC_EVERY_STATS
+      h.stats.site = File ^ static_cast<uint32_t>(Tag);
+#else
+      (void)h;
+#endif
+    }
+
+    // Raw storage for an optional value that is trivially destructible itself, so that a static
+    // holding it needs no destructor registration (and therefore no guard). The value is never
+    // destroyed at exit.
+    template <typename T>
+    struct Storage {
+      alignas(T) unsigned char bytes[sizeof(T)];
+      bool has = false;
+      constexpr Storage(): bytes{} {}
+
+      bool valid() const { return has; }
+      T &value() { return *static_cast<T*>(static_cast<void*>(bytes)); }
+      T const &value() const { return *static_cast<T const*>(static_cast<void const*>(bytes)); }
+      void clear() {
+        if (has) value().~T();
+        has = false;
+      }
+    };
   } // namespace detail
 
 
+  // Plain optional-like value, returned by the *_lite macros. Holds only the value and a flag;
+  // there is no handle and no virtual printTo(). Use exec::print() to print it.
   template <typename T>
-  class Maybe: public detail::MaybePrintable<Maybe<T>, detail::IsPrintable<T>::value> {
-    static_assert(!detail::IsRvalueReference<T>::value, "Maybe<T&&> not supported");
+  class Optional {
+    static_assert(!detail::IsRvalueReference<T>::value, "Optional<T&&> not supported");
+  protected:
     using ValueType    = detail::RemoveReference<T>;
     using BareType     = detail::BareType<T>;
     using StorageType  = detail::Conditional<detail::IsReference<T>::value, ValueType*, ValueType>;
-    
-    template <typename R> friend detail::HandleBase *getHandle(Maybe<R>&);
-    template <typename R> friend detail::HandleBase *getHandle(Maybe<R>&&);
+
+  private:
     friend struct detail::MaybeFactory;
 
-    bool has = false;
-    detail::HandleBase* handle;
     struct StorageBox { StorageType obj; };
     union { StorageBox box; };
+    bool has;
 
-    Maybe(detail::HandleBase* handle) : has(false), handle(handle) {}
-    
-    Maybe(detail::HandleBase* handle, ValueType&& obj) : has(true), handle(handle) {
+  protected:
+    Optional(ValueType&& obj) : has(true) {
       new (&box) StorageBox{ detail::move(obj) };
     }
 
     template <typename R = T, detail::EnableIf<!detail::IsReference<R>::value, int> = 0>
-    Maybe(detail::HandleBase* handle, ValueType const &obj) : has(true), handle(handle) {
+    Optional(ValueType const &obj) : has(true) {
       new (&box) StorageBox{ obj };
     }
 
     template <typename R = T, detail::EnableIf<detail::IsReference<R>::value, int> = 0>
-    Maybe(detail::HandleBase* handle, ValueType& obj) : has(true), handle(handle) {
+    Optional(ValueType& obj) : has(true) {
       new (&box) StorageBox{ &obj };
     }
     
   public:
-    Maybe(Maybe const &other) : has(other.has), handle(other.handle) {
+    Optional() : has(false) {}
+
+    Optional(Optional const &other) : has(other.has) {
       if (has) new (&box) StorageBox{ other.box.obj };
     }
 
-    Maybe(Maybe&& other) : has(other.has), handle(other.handle) {
+    Optional(Optional&& other) : has(other.has) {
       if (has) new (&box) StorageBox{ detail::move(other.box.obj) };      
       other.reset();
     }
 
-    Maybe &operator=(Maybe const &other) {
+    Optional &operator=(Optional const &other) {
       if (this == &other) return *this;
       if (has) reset();
       has = other.has;
-      handle = other.handle;
       if (has) new (&box) StorageBox{ other.box.obj };
       return *this;
     }
 
-    Maybe &operator=(Maybe&& other) {
+    Optional &operator=(Optional&& other) {
       if (this == &other) return *this;
       if (has) reset();
       has = other.has;
-      handle = other.handle;
       if (has) new (&box) StorageBox{ detail::move(other.box.obj) };
       other.reset();
       return *this;
     }
     
-    ~Maybe() { reset(); }
+    ~Optional() { reset(); }
 
     explicit operator bool() const      { return valid(); }
     bool valid() const                  { return has; }
@@ -148,8 +515,6 @@ namespace exec {
     ValueType *operator->()             { return &value(); }
     ValueType const *operator->() const { return &value(); }
 
-    ValueType &force(uint32_t dt = 0);
-
   private:
     ValueType &value_impl(ValueType&)                     { return   box.obj; }
     ValueType &value_impl(ValueType*)                     { return  *box.obj; }
@@ -165,23 +530,103 @@ namespace exec {
   };
 
   template <>
-  class Maybe<void> {
+  class Optional<void> {
+    friend struct detail::MaybeFactory;
+    bool has;
+  protected:
+    Optional(bool ran): has(ran) {}
+  public:
+    Optional(): has(false) {}
+    bool valid() const { return has; }
+    operator bool() const { return valid(); }
+  };
+
+  // Maybe<T> extends Optional<T> with the handle of the call site that produced it. This enables
+  // getHandle() and force().
+  template <typename T>
+  class Maybe: public Optional<T>, public detail::MaybePrintable<Maybe<T>, detail::IsPrintable<T>::value> {
+    using typename Optional<T>::ValueType;
+    
+    template <typename R> friend detail::HandleBase *getHandle(Maybe<R>&);
+    template <typename R> friend detail::HandleBase *getHandle(Maybe<R>&&);
+    friend struct detail::MaybeFactory;
+
+    detail::HandleBase* handle;
+
+    Maybe(detail::HandleBase* handle) : handle(handle) {}
+    
+    Maybe(detail::HandleBase* handle, ValueType&& obj) : Optional<T>(detail::move(obj)), handle(handle) {}
+
+    template <typename R = T, detail::EnableIf<!detail::IsReference<R>::value, int> = 0>
+    Maybe(detail::HandleBase* handle, ValueType const &obj) : Optional<T>(obj), handle(handle) {}
+
+    template <typename R = T, detail::EnableIf<detail::IsReference<R>::value, int> = 0>
+    Maybe(detail::HandleBase* handle, ValueType& obj) : Optional<T>(obj), handle(handle) {}
+    
+  public:
+    Maybe(Maybe const &) = default;
+    Maybe(Maybe&&) = default;
+    Maybe &operator=(Maybe const &) = default;
+    Maybe &operator=(Maybe&&) = default;
+
+    ValueType &force(uint32_t dt = 0);
+  };
+
+  template <>
+  class Maybe<void>: public Optional<void> {
     template <typename R> friend detail::HandleBase* getHandle(Maybe<R>&);
     template <typename R> friend detail::HandleBase* getHandle(Maybe<R>&&);
     friend struct detail::MaybeFactory;
-    bool has;
     detail::HandleBase* handle;
-    Maybe(detail::HandleBase* handle, bool ran = false): has(ran), handle(handle) {}
+    Maybe(detail::HandleBase* handle, bool ran = false): Optional<void>(ran), handle(handle) {}
   public:
     Maybe(Maybe&&) = default;
     Maybe(Maybe const &) = default;
     Maybe &operator=(Maybe const &) = default;
     Maybe &operator=(Maybe&&) = default;
-    bool valid() const { return has; }
-    operator bool() const { return valid(); }
     void force(uint32_t dt = 0);
   };
 
+  // Result of a caching call site (exec_every_cached). The last result is stored in the handle of 
+  // the call site; Cached<T> is only a view of it: the handle (type-erased, for force() and 
+  // getHandle()), a pointer to the stored result inside that handle, a flag, and a vptr if T is
+  // printable. value() is available on passes where the callback ran, lastValue() once it ran at
+  // least once. Both are valid until the next run of the call site.
+  template <typename T>
+  class Cached: public detail::MaybePrintable<Cached<T>, detail::IsPrintable<T>::value> {
+    template <typename R> friend detail::HandleBase *getHandle(Cached<R> const &);
+    friend struct detail::MaybeFactory;
+
+    detail::HandleBase *handle;
+    detail::Storage<T> const *last;
+    bool ran;
+
+    Cached(detail::HandleBase *handle, detail::Storage<T> const *last, bool ran): handle(handle), last(last), ran(ran) {}
+  public:
+    explicit operator bool() const  { return valid(); }
+    bool valid() const              { return ran; }
+    T const &value() const          { return last->value(); }
+    T const &operator*() const      { return value(); }
+    T const *operator->() const     { return &value(); }
+
+    bool hasLastValue() const       { return last->valid(); }
+    T const &lastValue() const      { return last->value(); }
+
+    T const &force(uint32_t dt = 0) {
+      if (!ran) {
+        handle->dispatch(detail::Op::Exec, nullptr, dt);
+        ran = true;
+      }
+      return value();
+    }
+  };
+
+  // Non-virtual printing of both Optional<T> and Maybe<T>.
+  template <typename T>
+  inline size_t print(Print &p, Optional<T> const &opt) {
+    return opt.valid() ? p.print(opt.value()) : p.print("<empty>");
+  }
+
   namespace detail {
     template <typename F> inline auto invoke(F&& f, uint32_t const dt, int) -> decltype(f(dt)) { return f(dt); }
     template <typename F> inline auto invoke(F&& f, uint32_t const, long)   -> decltype(f())   { return f();   }
@@ -194,6 +639,18 @@ namespace exec {
       template <typename T> static Maybe<T> empty(HandleBase* h) { return Maybe<T>{h}; }
       template <typename T> static Maybe<T> value(HandleBase* h, T&& v) { return Maybe<T>{h, forward<T>(v)}; }
       static Maybe<void> voidValue(HandleBase *h) { return Maybe<void>{h, true}; }
+      template <typename T> static Optional<T> optional(T&& v) { return Optional<T>{forward<T>(v)}; }
+      static Optional<void> voidOptional() { return Optional<void>{true}; }
+      template <typename T> static Cached<T> cached(HandleBase *h, Storage<T> const *last, bool ran) { return Cached<T>{h, last, ran}; }
+
+      // Replace the stored value with the result of f(dt), constructed in place. The previous
+      // value is destroyed first, so it must not be read by f.
+      template <typename T, typename F> 
+      static void emplace(Storage<T> &storage, F&& f, uint32_t dt) {
+        storage.clear();
+        new (storage.bytes) T(invoke(f, dt, 0));
+        storage.has = true;
+      }
     };
 
     template <typename Ret>
@@ -202,6 +659,11 @@ namespace exec {
       inline static Maybe<Ret> run(F&& f, uint32_t dt, HandleBase* handle) {
         return MaybeFactory::value<Ret>(handle, invoke(f, dt, 0));
       }
+
+      template <typename F>
+      inline static Optional<Ret> run(F&& f, uint32_t dt) {
+        return MaybeFactory::optional<Ret>(invoke(f, dt, 0));
+      }
     };
 
     template <>
@@ -211,114 +673,1908 @@ namespace exec {
         invoke(f, dt, 0);
         return MaybeFactory::voidValue(handle);
       }
+
+      template <typename F>
+      inline static Optional<void> run(F&& f, uint32_t dt) {
+        invoke(f, dt, 0);
+        return MaybeFactory::voidOptional();
+      }
     };
 
     using MillisFunc = uint32_t(*)();
 
-    template <typename T>
-    class LocalHandle: public HandleBase {
-      uint32_t last;
-      MillisFunc millis;
-    public:
-      LocalHandle(MillisFunc millis): last(millis()), millis(millis) {}
-      uint32_t dt(uint32_t now) const { return now - last; }
-      void reset(uint32_t now) { last = now; }
-      virtual void reset() override { reset(millis()); }
-      virtual Maybe<T> exec(uint32_t) = 0;
+    inline unsigned core() { return EXEC_EVERY_CORE_ID(); }
+
+    // One snapshot per clock function (and per core). While active, every call site driven by 
+    // that clock uses the stored value instead of reading the clock itself.
+    template <MillisFunc millis>
+    struct Snapshot {
+      uint32_t now;
+      bool active;
+
+      static Snapshot perCore[EXEC_EVERY_CORES];
+      static Snapshot &get() { return perCore[core()]; }
     };
+    template <MillisFunc millis> Snapshot<millis> Snapshot<millis>::perCore[EXEC_EVERY_CORES] = {};
 
-    
-  } // namespace detail
+    template <MillisFunc millis>
+    inline uint32_t now() { 
+      Snapshot<millis> const &snapshot = Snapshot<millis>::get();
+      return snapshot.active ? snapshot.now : millis(); 
+    }
 
-  using Handle = detail::HandleBase*;
-  template <typename T> inline Handle getHandle(Maybe<T> &&maybe) { return maybe.handle; }
-  template <typename T> inline Handle getHandle(Maybe<T> &maybe)  { return maybe.handle; }
-  inline void reset(Handle h) { detail::reset(h); }
+    // Per-pass time budget in microseconds (0: unlimited), and the start of the current pass on
+    // each core as recorded by tick().
+    template <typename = void>
+    struct Budget {
+      uint32_t start;
 
-  namespace detail {
-    
-    template <typename R> struct ForceReturn {
-      template <typename T> static R get(Maybe<T> &maybe) { return maybe.value(); }
+      static uint32_t limit;
+      static uint32_t deferred;
+      static Budget perCore[EXEC_EVERY_CORES];
+      static Budget &get() { return perCore[core()]; }
     };
+    template <typename T> uint32_t Budget<T>::limit = 0;
+    template <typename T> uint32_t Budget<T>::deferred = 0;
+    template <typename T> Budget<T> Budget<T>::perCore[EXEC_EVERY_CORES] = {};
 
-    template <> struct ForceReturn<void> {
-      static void get(Maybe<void> &) {}
+    // Counters shared by all cores (budget deferrals, stagger sequence).
+#ifdef EXEC_EVERY_MULTICORE
+    inline uint32_t increment(uint32_t &counter) { return __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED); }
+    inline uint32_t load(uint32_t const &counter) { return __atomic_load_n(&counter, __ATOMIC_RELAXED); }
+#else
+    inline uint32_t increment(uint32_t &counter) { return ++counter; }
+    inline uint32_t load(uint32_t const &counter) { return counter; }
+#endif
+
+    // Initial phase of a call site: how far into its first period it starts. An explicit phase is
+    // taken modulo the interval. Otherwise, with EXEC_EVERY_STAGGER, the k-th call site gets the
+    // fraction k * 0.618 (mod 1) of its interval, which spreads any number of consecutively created
+    // call sites evenly over the period.
+    enum: uint32_t { AutoPhase = 0xffffffff };
+
+#ifdef EXEC_EVERY_STAGGER
+    template <typename = void>
+    struct Stagger {
+      static uint32_t count;
     };
+    template <typename T> uint32_t Stagger<T>::count = 0;
+#endif
 
-    template <typename R, typename T>
-    inline R force(Maybe<T> &maybe, uint32_t dt) {
-      if (maybe) return ForceReturn<R>::get(maybe);
-      maybe = static_cast<LocalHandle<T>*>(getHandle(maybe))->exec(dt);
-      return ForceReturn<R>::get(maybe);
+    inline uint32_t phase(uint32_t const interval, uint32_t const phase = AutoPhase) {
+      if (interval == 0) return 0;
+      if (phase != AutoPhase) return phase % interval;
+#ifdef EXEC_EVERY_STAGGER
+      uint32_t const fraction = increment(Stagger<>::count) * 0x9e3779b9u;
+      return static_cast<uint32_t>((static_cast<uint64_t>(fraction) * interval) >> 32);
+#else
+      return 0;
+#endif
     }
-  }
 
-  template <typename T> inline typename Maybe<T>::ValueType &Maybe<T>::force(uint32_t dt) { 
-    return detail::force<typename Maybe<T>::ValueType &>(*this, dt); 
-  }
-  inline void Maybe<void>::force(uint32_t dt) { 
-    detail::force<void>(*this, dt); 
-  }
+#ifdef EXEC_EVERY_DEADLINES
+    // Earliest deadline of all call sites (using the same clock) that were polled since the 
+    // last call to tick().
+    template <MillisFunc millis>
+    struct Deadline {
+      uint32_t at;
+      bool pending;
 
-  template <int Tag, detail::MillisFunc millis, typename RunCondition, typename ThrottleCondition, typename F>
-  inline auto every_if_throttled_impl(uint32_t const interval, 
-                                      RunCondition &&runCondition, 
-                                      ThrottleCondition &&throttleCondition, 
-                                      F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
-    
-    using Ret = decltype(detail::invoke(f, 0, 0));
-    using Callback = detail::DecayFunction<detail::BareType<F>>;
+      static Deadline perCore[EXEC_EVERY_CORES];
+      static Deadline &get() { return perCore[core()]; }
 
-    static struct LocalHandle: public detail::LocalHandle<Ret> {
-      Callback f;
-      LocalHandle(Callback f): detail::LocalHandle<Ret>(millis), f(detail::move(f)) {}
-      virtual Maybe<Ret> exec(uint32_t dt) override {
-        return detail::RunAndReturn<Ret>::run(f, dt, this);
+      static void note(uint32_t const now, uint32_t const remaining) {
+        Deadline &d = get();
+        uint32_t const deadline = now + remaining;
+        if (!d.pending || static_cast<int32_t>(deadline - d.at) < 0) {
+          d.at = deadline;
+          d.pending = true;
+        }
       }
-    } handle(Callback(detail::move(f)));
+    };
+    template <MillisFunc millis> Deadline<millis> Deadline<millis>::perCore[EXEC_EVERY_CORES] = {};
+#endif
 
-    uint32_t const now = millis();
-    uint32_t const dt  = handle.dt(now);
-    if (dt >= interval && detail::eval(throttleCondition, dt)) {
-      handle.reset(now);
-      if (detail::eval(runCondition, dt)) return handle.exec(dt);
-    }
-    return detail::MaybeFactory::empty<Ret>(&handle);
-  }  
+    // The timestamp is stored with the width of Stamp (uint8_t, uint16_t or uint32_t). Clock values
+    // are truncated to this width and all arithmetic wraps at this width, so intervals (and the time
+    // between consecutive runs) must stay below 2^N ticks.
+    // In multicore mode, the timestamp is accessed atomically and advanced with a compare-and-swap,
+    // so that only one core can claim an expiry.
+    template <typename Stamp = uint32_t>
+    class Timer {
+      Stamp last;
+    public:
+      using StampType = Stamp;
+      constexpr Timer(): last(0) {}
+      Timer(uint32_t now): last(static_cast<Stamp>(now)) {}
+      Stamp dt(uint32_t now) const { return static_cast<Stamp>(static_cast<Stamp>(now) - stamp()); }
+#ifdef EXEC_EVERY_MULTICORE
+      Stamp stamp() const { return __atomic_load_n(&last, __ATOMIC_ACQUIRE); }
+      void reset(uint32_t now) { __atomic_store_n(&last, static_cast<Stamp>(now), __ATOMIC_RELEASE); }
+      bool advance(Stamp from, Stamp by) { 
+        return __atomic_compare_exchange_n(&last, &from, static_cast<Stamp>(from + by), false, 
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); 
+      }
+#else
+      Stamp stamp() const { return last; }
+      void reset(uint32_t now) { last = static_cast<Stamp>(now); }
+      bool advance(Stamp from, Stamp by) { last = static_cast<Stamp>(from + by); return true; }
+#endif
+    };
 
-  // Run at every interval regardless of any conditions.
-  template <int Tag, detail::MillisFunc millis, typename F>
-  inline auto every_impl(uint32_t const interval, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
-    return every_if_throttled_impl<Tag, millis>(interval, true, true, f);
-  }
-  
-  // Run only when the interval expires and the condition is met at that moment in time. If the interval
-  // expires and the condition is not met, the timer is reset and the condition is checked when it 
-  // expires again.
-  template <int Tag, detail::MillisFunc millis, typename C, typename F>
-  inline auto every_if_impl(uint32_t const interval, C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
-    return every_if_throttled_impl<Tag, millis>(interval, c, true, f);
-  }
+    template <typename Stamp = uint32_t>
+    class LocalHandle: public HandleBase, public Timer<Stamp> {
+    public:
+      constexpr LocalHandle() {}
+      LocalHandle(Thunk thunk, uint32_t now): HandleBase(thunk), Timer<Stamp>(now) {}
 
-  // Run as soon as the interval has expired and the condition is met. If the condition is not met, 
-  // the timer keeps running and the condition is checked each subsequent time until it evaluates 
-  // to true.
-  template <int Tag, detail::MillisFunc millis = ::millis, typename C, typename F>
-  inline auto throttled_impl(uint32_t const interval, C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
-    return every_if_throttled_impl<Tag, millis>(interval, true, c, f);
-  }  
+      // Set the timestamp to elapsed before now, limited to half the range of the timestamp (so
+      // that any interval the call site can use has expired).
+      void restore(uint32_t const now, uint32_t const elapsed) {
+        Stamp const limit = static_cast<Stamp>(static_cast<Stamp>(~Stamp(0)) >> 1);
+        this->reset(now - (elapsed < limit ? elapsed : limit));
+      }
+    protected:
+      void start(Thunk thunk, uint32_t now) {
+        this->reset(now);
+        HandleBase::start(thunk);
+      }
+    };
 
-} // namespace exec
+    // Timer of a lite call site: just its timestamp, which starts at 0, so the first interval 
+    // counts from the start of the clock. Staggering needs a hook on first use, and with it a flag.
+    template <typename Stamp>
+    struct LiteTimer: public Timer<Stamp> {
+#ifdef EXEC_EVERY_STAGGER
+      bool started = false;
+#endif
+      constexpr LiteTimer() {}
+    };
 
+    // Callback storage of a constant-initialized handle. Stateless callbacks (captureless lambdas)
+    // take no space: calling them does not access the object, so they are invoked through the 
+    // (empty) slot itself.
+    template <typename Callback, bool Stateless = __is_empty(Callback) && __is_trivially_copyable(Callback)>
+    struct CallbackSlot {
+      alignas(Callback) unsigned char bytes[sizeof(Callback)];
+      constexpr CallbackSlot(): bytes{} {}
+      void store(Callback &&f) { new (bytes) Callback(detail::move(f)); }
+      void destroy() { callback().~Callback(); }
+      Callback &callback() { return *static_cast<Callback*>(static_cast<void*>(bytes)); }
+    };
 
-#ifndef __COUNTER__
-#define __COUNTER__ __LINE__
-#endif
+    template <typename Callback>
+    struct CallbackSlot<Callback, true> {
+      void store(Callback &&) {}
+      void destroy() {}
+      Callback &callback() { return *static_cast<Callback*>(static_cast<void*>(this)); }
+    };
+
+  } // namespace detail
 
-#define exec_every_with(millisFunc, interval, ...) exec::every_impl<__COUNTER__, (millisFunc)>((interval), __VA_ARGS__)
-#define exec_every_if_with(millisFunc, interval, condition, ...) exec::every_if_impl<__COUNTER__, (millisFunc)>((interval), (condition), __VA_ARGS__)
-#define exec_throttled_with(millisFunc, interval, condition, ...) exec::throttled_impl<__COUNTER__, (millisFunc)>((interval), (condition), __VA_ARGS__)
+  // Expiry policies. When the interval expires, the timestamp of the call site is advanced by
+  // the amount returned by Policy::advance(elapsed, interval).
 
-#define exec_every(interval, ...) exec_every_with(::millis, (interval), __VA_ARGS__)
-#define exec_every_if(interval, condition, ...) exec_every_if_with(::millis, (interval), (condition), __VA_ARGS__)
-#define exec_throttled(interval, condition, ...) exec_throttled_with(::millis, (interval), (condition), __VA_ARGS__)
\ No newline at end of file
+  // Default: restart the interval from the current time. Loop jitter accumulates as phase drift.
+  struct Relative {
+    template <typename Stamp> static Stamp advance(Stamp elapsed, Stamp) { return elapsed; }
+  };
+
+  // Anchored: advance by exactly one interval so the call site stays on a fixed grid. After an 
+  // overrun (more than one full interval late), run once and restart the grid from now.
+  struct Resync {
+    template <typename Stamp> static Stamp advance(Stamp elapsed, Stamp interval) {
+      return (static_cast<Stamp>(elapsed - interval) < interval) ? interval : elapsed;
+    }
+  };
+
+  // Anchored: advance by exactly one interval so the call site stays on a fixed grid. After an 
+  // overrun, up to N missed periods are caught up on subsequent passes; any periods beyond that 
+  // are skipped without shifting the grid.
+  template <unsigned N>
+  struct Burst {
+    template <typename Stamp> static Stamp advance(Stamp elapsed, Stamp interval) {
+      if (interval == 0) return elapsed;
+      if (static_cast<Stamp>(elapsed - interval) < interval) return interval;
+      Stamp const periods = elapsed / interval;
+      return (periods <= N + 1) ? interval : static_cast<Stamp>((periods - N) * interval);
+    }
+  };
+
+  // Anchored: after an overrun, missed periods are skipped without shifting the grid.
+  using Skip = Burst<0>;
+
+  // Token bucket (exec_throttled_burst): the time elapsed since the timestamp is credit, capped at 
+  // N intervals, and every run spends one interval of it. Up to N runs can follow each other 
+  // immediately, while the long-term rate stays at one run per interval. Call sites start with a
+  // full bucket.
+  template <unsigned N>
+  struct TokenBucket {
+    template <typename Stamp> static Stamp advance(Stamp elapsed, Stamp interval) {
+      Stamp const capacity = static_cast<Stamp>(N * interval);
+      return static_cast<Stamp>((elapsed > capacity ? elapsed - capacity : 0) + interval);
+    }
+  };
+
+  namespace detail {
+    // Time by which the timestamp of a new call site is set back: its phase (see phase()), or the
+    // full capacity of a token bucket.
+    template <typename Policy> 
+    struct InitialCredit {
+      static uint32_t get(uint32_t interval, uint32_t p) { return phase(interval, p); }
+    };
+
+    template <unsigned N> 
+    struct InitialCredit<TokenBucket<N>> {
+      static uint32_t get(uint32_t interval, uint32_t) { return N * interval; }
+    };
+  }
+
+  // Event flag that can be armed from an interrupt and consumed in loop context by exec_on_event.
+  // Arming is a single byte store and consuming never masks interrupts: an event that arrives
+  // between checking and clearing the flag happened before the callback runs, so it is covered 
+  // by that run. Multiple events before the callback runs are coalesced into a single run.
+  class Trigger {
+    volatile bool armed = false;
+  public:
+    void arm()           { armed = true; }
+    bool pending() const { return armed; }
+
+    // Consume the event; used as the throttle condition of exec_on_event.
+    bool operator()() {
+      if (!armed) return false;
+      armed = false;
+      return true;
+    }
+  };
+
+  // Index of the calling core; always 0 unless EXEC_EVERY_MULTICORE is defined.
+  inline unsigned coreId() { return detail::core(); }
+
+  // Throttle condition pinning a call site to one core; used by exec_every_on.
+  class OnCore {
+    unsigned pinned;
+  public:
+    explicit OnCore(unsigned core): pinned(core) {}
+    bool matches() const { return detail::core() == pinned; }
+    bool operator()() const { return matches(); }
+  };
+
+  // Priorities of budgeted call sites (exec_every_prio); any value in 0..255 can be used.
+  struct Priority {
+    enum: uint8_t { Low = 63, Normal = 127, High = 255 };
+  };
+
+  // Set the time budget per pass in microseconds, measured from tick(); 0 disables load shedding.
+  inline void budget(uint32_t const us) { detail::Budget<>::limit = us; }
+
+  // Number of runs deferred to a later pass because the budget was exhausted.
+  inline uint32_t deferred() { return detail::load(detail::Budget<>::deferred); }
+
+  // Throttle condition of a budgeted call site: a due call site of priority p is deferred to the
+  // next pass once more than (p + 1) / 256 of the budget has been used in the current pass.
+  class WithinBudget {
+    uint8_t priority;
+  public:
+    explicit WithinBudget(uint8_t priority): priority(priority) {}
+    bool operator()() const {
+      uint32_t const limit = detail::Budget<>::limit;
+      if (limit == 0) return true;
+      uint32_t const used = ::micros() - detail::Budget<>::get().start;
+      if (used <= static_cast<uint32_t>((static_cast<uint64_t>(limit) * (priority + 1u)) >> 8)) return true;
+      detail::increment(detail::Budget<>::deferred);
+      return false;
+    }
+  };
+
+  namespace detail {
+    enum class Due: uint8_t { No, Skipped, Run };
+
+#ifdef EXEC_EVERY_DEADLINES
+    // Whether a call site contributes to the deadline tracking. Call sites waiting for a trigger
+    // that has not been armed do not: the interrupt arming it will wake the MCU anyway.
+    template <typename C> inline bool wantsDeadline(C const &) { return true; }
+    inline bool wantsDeadline(Trigger const &trigger) { return trigger.pending(); }
+    inline bool wantsDeadline(OnCore const &onCore) { return onCore.matches(); }
+#endif
+
+    // Timing logic shared by all call sites. Returns Due::Run if the callback should run and
+    // Due::Skipped if the interval expired but the run condition was not met; dt is set to the 
+    // time elapsed since the previous expiry.
+    template <MillisFunc millis, typename Policy, typename Stamp, typename RunCondition, typename ThrottleCondition>
+    inline Due dueInline(Timer<Stamp> &timer, typename Timer<Stamp>::StampType const interval,
+                         RunCondition &&runCondition, ThrottleCondition &&throttleCondition, uint32_t &dt) {
+#ifdef EXEC_EVERY_PROFILE
+      loopProfiler().poll();
+#endif
+      uint32_t const now = detail::now<millis>();
+      Stamp const last = timer.stamp();
+      Stamp const elapsed = static_cast<Stamp>(static_cast<Stamp>(now) - last);
+      dt = elapsed;
+      Due result = Due::No;
+      if (elapsed >= interval && eval(throttleCondition, dt)) {
+        // Fails only in multicore mode, when another core claimed this expiry first.
+        if (timer.advance(last, Policy::advance(elapsed, interval)))
+          result = eval(runCondition, dt) ? Due::Run : Due::Skipped;
+      }
+#ifdef EXEC_EVERY_DEADLINES
+      if (wantsDeadline(throttleCondition)) {
+        Stamp const pending = timer.dt(now);
+        Deadline<millis>::note(now, pending >= interval ? 0 : static_cast<Stamp>(interval - pending));
+      }
+#endif
+      return result;
+    }
+
+    // Out-of-line copy for call sites whose conditions are plain values (exec_every, and the
+    // conditions of exec_every_if/exec_throttled unless they are callables): all such call sites 
+    // with the same clock, policy and timestamp type share it, so that a call site only adds the
+    // call and its callback.
+    template <MillisFunc millis, typename Policy, typename Stamp>
+    EXEC_EVERY_NOINLINE Due dueShared(Timer<Stamp> &timer, Stamp const interval, bool const runCondition, 
+                                      bool const throttleCondition, uint32_t &dt) {
+      return dueInline<millis, Policy>(timer, interval, runCondition, throttleCondition, dt);
+    }
+
+    template <bool Shared> struct DueDispatch {
+      template <MillisFunc millis, typename Policy, typename Stamp, typename RunCondition, typename ThrottleCondition>
+      static Due due(Timer<Stamp> &timer, Stamp const interval, RunCondition &&runCondition, 
+                     ThrottleCondition &&throttleCondition, uint32_t &dt) {
+        return dueInline<millis, Policy>(timer, interval, runCondition, throttleCondition, dt);
+      }
+    };
+
+    template <> struct DueDispatch<true> {
+      template <MillisFunc millis, typename Policy, typename Stamp>
+      static Due due(Timer<Stamp> &timer, Stamp const interval, bool const runCondition, 
+                     bool const throttleCondition, uint32_t &dt) {
+        return dueShared<millis, Policy>(timer, interval, runCondition, throttleCondition, dt);
+      }
+    };
+
+    template <MillisFunc millis, typename Policy, typename Stamp, typename RunCondition, typename ThrottleCondition>
+    inline Due due(Timer<Stamp> &timer, typename Timer<Stamp>::StampType const interval,
+                   RunCondition &&runCondition, ThrottleCondition &&throttleCondition, uint32_t &dt) {
+      using Dispatch = DueDispatch<IsSame<BareType<RunCondition>, bool>::value && IsSame<BareType<ThrottleCondition>, bool>::value>;
+      return Dispatch::template due<millis, Policy>(timer, interval, static_cast<RunCondition&&>(runCondition), 
+                                                    static_cast<ThrottleCondition&&>(throttleCondition), dt);
+    }
+  } // namespace detail
+
+  // Read the clock once and let all subsequent call sites (using the same clock) reuse this
+  // value until the next call to tick() or until release() is called.
+  template <detail::MillisFunc millis = ::millis>
+  inline uint32_t tick() {
+#ifdef EXEC_EVERY_DEADLINES
+    detail::Deadline<millis>::get().pending = false;
+#endif
+    detail::Snapshot<millis> &snapshot = detail::Snapshot<millis>::get();
+    snapshot.active = true;
+    snapshot.now = millis();
+    if (detail::Budget<>::limit) 
+      detail::Budget<>::get().start = millis == static_cast<detail::MillisFunc>(::micros) ? snapshot.now : ::micros();
+#ifdef EXEC_EVERY_PROFILE
+    loopProfiler().pass(millis == static_cast<detail::MillisFunc>(::micros) ? snapshot.now : ::micros());
+#endif
+    return snapshot.now;
+  }
+
+  // Stop using the snapshot; call sites read the clock themselves again.
+  template <detail::MillisFunc millis = ::millis>
+  inline void release() {
+    detail::Snapshot<millis>::get().active = false;
+  }
+
+  // Scoped snapshot: takes a snapshot on construction, releases it on destruction.
+  template <detail::MillisFunc millis = ::millis>
+  struct Frame {
+    uint32_t const now;
+    Frame(): now(tick<millis>()) {}
+    ~Frame() { release<millis>(); }
+    Frame(Frame const &) = delete;
+    Frame &operator=(Frame const &) = delete;
+  };
+
+#ifdef EXEC_EVERY_DEADLINES
+  // True if at least one call site has been polled since the last call to tick().
+  template <detail::MillisFunc millis = ::millis>
+  inline bool hasDeadline() {
+    return detail::Deadline<millis>::get().pending;
+  }
+
+  // Absolute time (in clock ticks) at which the earliest call site polled since the last call
+  // to tick() is due. Only meaningful when hasDeadline() returns true.
+  template <detail::MillisFunc millis = ::millis>
+  inline uint32_t nextDeadline() {
+    return detail::Deadline<millis>::get().at;
+  }
+
+  // Time until the earliest deadline, measured against the actual clock (not the snapshot). 
+  // Returns 0 if a call site is already due and 0xffffffff if no call site has been polled.
+  template <detail::MillisFunc millis = ::millis>
+  inline uint32_t idleFor() {
+    detail::Deadline<millis> const &deadline = detail::Deadline<millis>::get();
+    if (!deadline.pending) return 0xffffffff;
+    int32_t const remaining = static_cast<int32_t>(deadline.at - millis());
+    return remaining > 0 ? static_cast<uint32_t>(remaining) : 0;
+  }
+#endif
+
+  using Handle = detail::HandleBase*;
+  template <typename T> inline Handle getHandle(Maybe<T> &&maybe) { return maybe.handle; }
+  template <typename T> inline Handle getHandle(Maybe<T> &maybe)  { return maybe.handle; }
+  template <typename T> inline Handle getHandle(Cached<T> const &cached) { return cached.handle; }
+  inline void reset(Handle h) { detail::reset(h); }
+
+  // Run the callback of a call site now, without restarting its interval; the result is 
+  // discarded. Use Maybe::force() to get the result.
+  inline void force(Handle h, uint32_t dt = 0) { if (h) h->dispatch(detail::Op::Exec, nullptr, dt); }
+
+#ifdef EXEC_EVERY_REGISTRY
+  // Call f(Handle) for every call site that has been reached at least once. Call sites are 
+  // visited from most to least recently constructed. Compact (*_lite) call sites have no handle 
+  // and are not included.
+  template <typename F>
+  inline void forEachHandle(F&& f) {
+    for (Handle h = detail::Registry<>::head; h; h = h->next()) f(h);
+  }
+
+  // Reset the timers of all registered call sites, e.g. after the clock has been adjusted.
+  inline void resetAll() {
+    for (Handle h = detail::Registry<>::head; h; h = h->next()) detail::reset(h);
+  }
+
+  // Persisting call sites across deep sleep (or any reset that restarts the clock from 0).
+  using SavedHandle = detail::SavedHandle;
+
+  // Store the time elapsed since the last run of every registered call site in buffer, e.g. in
+  // RTC memory right before going to sleep. Returns the number of entries written.
+  inline uint16_t saveHandles(SavedHandle *buffer, uint16_t const capacity) {
+    uint16_t n = 0;
+    for (Handle h = detail::Registry<>::head; h && n != capacity; h = h->next(), ++n) {
+      buffer[n].key = detail::key(h);
+      h->dispatch(detail::Op::Save, &buffer[n].elapsed);
+    }
+    return n;
+  }
+
+  // Continue the saved call sites after a sleep of the given number of milliseconds (counted up 
+  // to the clock's restart). Call sites that have already been started are restored right away, 
+  // the others when they are first reached, so the buffer must remain valid. Only call sites 
+  // driven by millis() or micros() are restored; those on other clocks start a fresh interval.
+  inline void restoreHandles(SavedHandle const *saved, uint16_t const count, uint32_t const slept) {
+    detail::Saved<>::entries = saved;
+    detail::Saved<>::count = count;
+    detail::Saved<>::slept = slept;
+    for (Handle h = detail::Registry<>::head; h; h = h->next())
+      if (SavedHandle const *entry = detail::saved(h)) 
+        h->dispatch(detail::Op::Restore, const_cast<SavedHandle*>(entry));
+  }
+#endif
+
+#ifdef EXEC_EVERY_STATS
+  inline Stats &stats(Handle h) { return h->stats; }
+
+#ifdef EXEC_EVERY_REGISTRY
+  // Printable report of the statistics of all registered call sites, one line per call site:
+  //   Serial.print(exec::StatsReport{});
+  struct StatsReport: public Printable {
+    virtual size_t printTo(Print &p) const override {
+      size_t n = 0;
+      unsigned index = 0;
+      forEachHandle([&](Handle h) {
+        n += p.print('#'); n += p.print(index++); n += p.print(": ");
+        n += exec::print(p, h->stats);
+        n += p.print("\r\n");
+      });
+      return n;
+    }
+  };
+
+  namespace detail {
+    inline uint8_t *put16(uint8_t *p, uint16_t const v) {
+      p[0] = static_cast<uint8_t>(v);
+      p[1] = static_cast<uint8_t>(v >> 8);
+      return p + 2;
+    }
+    inline uint8_t *put32(uint8_t *p, uint32_t const v) { return put16(put16(p, static_cast<uint16_t>(v)), static_cast<uint16_t>(v >> 16)); }
+  } // namespace detail
+
+  // Binary export of the statistics of all registered call sites, for decoding on a host. A 
+  // snapshot is a header followed by one fixed-size record per call site, all little-endian:
+  //   header (12 bytes): 'E' 'X' version recordSize | count: u16 | reserved: u16 | millis(): u32
+  //   record (32 bytes): id | runs | skipped | minDuration | maxDuration | meanDuration: u32
+  //                      | minJitter | maxJitter: i32
+  // The id is the stable id of the call site (detail::fileId(): a hash of the base name of its
+  // source file, xor its __COUNTER__ value), 0 for TaskPool slots. Durations are in microseconds,
+  // jitter in ticks of the call site's clock.
+  class TelemetryWriter {
+    Handle next = nullptr;
+    uint16_t remaining = 0;
+    bool header = false;
+
+  public:
+    static constexpr uint8_t version = 1;
+    static constexpr uint8_t headerSize = 12;
+    static constexpr uint8_t recordSize = 32;
+
+    // Start a new snapshot. Call sites registered after this are not part of it.
+    void begin() {
+      next = detail::Registry<>::head;
+      remaining = 0;
+      for (Handle h = next; h; h = h->next()) ++remaining;
+      header = true;
+    }
+
+    bool done() const { return !header && remaining == 0; }
+
+    // Copy as much of the snapshot as fits into buffer, in whole header/records, and return the 
+    // number of bytes written (0 when the snapshot is complete or capacity is too small).
+    uint16_t read(uint8_t *buffer, uint16_t const capacity) {
+      uint8_t *p = buffer;
+      if (header) {
+        if (capacity < headerSize) return 0;
+        *p++ = 'E'; 
+        *p++ = 'X'; 
+        *p++ = version; 
+        *p++ = recordSize;
+        p = detail::put16(p, remaining);
+        p = detail::put16(p, 0);
+        p = detail::put32(p, millis());
+        header = false;
+      }
+      while (remaining && static_cast<uint16_t>(capacity - (p - buffer)) >= recordSize) {
+        Stats const &s = next->stats;
+        p = detail::put32(p, s.site);
+        p = detail::put32(p, s.runs);
+        p = detail::put32(p, s.skipped);
+        p = detail::put32(p, s.minDuration);
+        p = detail::put32(p, s.maxDuration);
+        p = detail::put32(p, s.meanDuration());
+        p = detail::put32(p, static_cast<uint32_t>(s.minJitter));
+        p = detail::put32(p, static_cast<uint32_t>(s.maxJitter));
+        next = next->next();
+        --remaining;
+      }
+      return static_cast<uint16_t>(p - buffer);
+    }
+
+    // Write up to the given number of records (and the header, if not written yet) to p, e.g. a
+    // few per pass. Returns true while the snapshot is not complete.
+    bool writeTo(Print &p, uint16_t records = 0xffff) {
+      uint8_t buffer[recordSize];
+      if (header) p.write(buffer, read(buffer, headerSize));
+      for (; records && remaining; --records) p.write(buffer, read(buffer, recordSize));
+      return !done();
+    }
+  };
+
+  // Write a complete snapshot at once: exec::writeTelemetry(Serial).
+  inline void writeTelemetry(Print &p) {
+    TelemetryWriter writer;
+    writer.begin();
+    writer.writeTo(p);
+  }
+#endif
+#endif
+
+  namespace detail {
+    
+    template <typename R> struct ForceReturn {
+      template <typename T> static R get(Maybe<T> &maybe) { return maybe.value(); }
+    };
+
+    template <> struct ForceReturn<void> {
+      static void get(Maybe<void> &) {}
+    };
+
+    template <typename R, typename T>
+    inline R force(Maybe<T> &maybe, uint32_t dt) {
+      if (maybe) return ForceReturn<R>::get(maybe);
+      getHandle(maybe)->dispatch(Op::Exec, &maybe, dt);
+      return ForceReturn<R>::get(maybe);
+    }
+  }
+
+  template <typename T> inline typename Maybe<T>::ValueType &Maybe<T>::force(uint32_t dt) { 
+    return detail::force<typename Maybe<T>::ValueType &>(*this, dt); 
+  }
+  inline void Maybe<void>::force(uint32_t dt) { 
+    detail::force<void>(*this, dt); 
+  }
+
+  namespace detail {
+#ifdef EXEC_EVERY_REGISTRY
+    // Only call sites driven by millis() or micros() are restored: the length of the sleep is 
+    // known in milliseconds, which cannot be converted to the ticks of an arbitrary clock.
+    template <MillisFunc millis>
+    inline bool restorable() {
+      return millis == static_cast<MillisFunc>(::millis) || millis == static_cast<MillisFunc>(::micros);
+    }
+
+    // Time since the saved timestamp of a handle, now that the clock has restarted from 0 after a
+    // sleep of Saved<>::slept milliseconds.
+    template <MillisFunc millis>
+    inline uint32_t restoredElapsed(SavedHandle const &saved, uint32_t const now) {
+      uint32_t const slept = millis == static_cast<MillisFunc>(::micros) ? Saved<>::slept * 1000 : Saved<>::slept;
+      return saved.elapsed + slept + now;
+    }
+#endif
+
+    // Timestamp of a handle that is being started: restored if its elapsed time was saved (see
+    // restoreHandles()), otherwise set back by its phase.
+    template <MillisFunc millis, typename Stamp>
+    inline uint32_t initialStamp(LocalHandle<Stamp> &handle, uint32_t const phase) {
+      uint32_t const t = now<millis>();
+#ifdef EXEC_EVERY_REGISTRY
+      if (SavedHandle const *entry = restorable<millis>() ? saved(&handle) : nullptr) {
+        handle.restore(t, restoredElapsed<millis>(*entry, t));
+        return handle.stamp();
+      }
+#else
+      (void)handle;
+#endif
+      return t - phase;
+    }
+
+    // Shared part of the thunks: handles Op::Reset, Op::Save and Op::Restore, and prepares Op::Run
+    // (dt measured with the call site's own timer, which is then reset). Returns whether the 
+    // callback is to be run.
+    template <MillisFunc millis, typename Stamp>
+    EXEC_EVERY_NOINLINE bool control(LocalHandle<Stamp> &handle, Op const op, void *out, uint32_t &dt) {
+      // Op::Exec (force()) runs with the dt given by the caller and needs no clock read.
+      if (op == Op::Exec) return true;
+      uint32_t const t = now<millis>();
+      switch (op) {
+      case Op::Reset: 
+        handle.reset(t); 
+        return false;
+      case Op::Run:
+        dt = handle.dt(t);
+        handle.reset(t);
+        return true;
+      case Op::Save:
+        *static_cast<uint32_t*>(out) = handle.dt(t);
+        return false;
+      case Op::Restore:
+#ifdef EXEC_EVERY_REGISTRY
+        if (restorable<millis>()) handle.restore(t, restoredElapsed<millis>(*static_cast<SavedHandle const*>(out), t));
+#endif
+        return false;
+      default:
+        return true;
+      }
+    }
+
+    // The handle of a call site: its timer, the callback and the thunk operating on both. Every
+    // call site has its own static instance.
+    template <MillisFunc millis, typename Stamp, typename Ret, typename Callback>
+    struct SiteHandle: public LocalHandle<Stamp>, public CallbackSlot<Callback> {
+      constexpr SiteHandle() {}
+      SiteHandle(Callback f, uint32_t phase = 0): LocalHandle<Stamp>(thunk, initialStamp<millis>(*this, phase)) { 
+        this->store(detail::move(f)); 
+      }
+
+      bool started() const { return HandleBase::started(thunk); }
+      // First use of a constant-initialized handle. Returns false if another core started it.
+      bool start(Callback &&f, uint32_t phase) {
+        if (!this->claim()) return false;
+        this->store(detail::move(f));
+        LocalHandle<Stamp>::start(thunk, initialStamp<millis>(*this, phase));
+        return true;
+      }
+
+      Maybe<Ret> exec(uint32_t dt) {
+        return RunAndReturn<Ret>::run(this->callback(), dt, this);
+      }
+      // Scheduled run (as opposed to force()), recorded in the statistics if enabled.
+      Maybe<Ret> run(uint32_t dt, uint32_t interval) {
+#if defined(EXEC_EVERY_STATS)
+        RunTiming timing(&this->stats, dt, interval);
+#elif defined(EXEC_EVERY_PROFILE)
+        RunTiming timing(nullptr, dt, interval);
+#else
+        (void)interval;
+#endif
+        return exec(dt);
+      }
+      // Op::Run is invoked by a Scheduler, which passes the interval; the result is discarded.
+      static void thunk(HandleBase *h, Op op, void *out, uint32_t dt) {
+        SiteHandle *self = static_cast<SiteHandle*>(h);
+        uint32_t const interval = dt;
+        if (!control<millis>(*self, op, out, dt)) return;
+        if (op != Op::Exec) self->run(dt, interval);
+        else if (out) *static_cast<Maybe<Ret>*>(out) = self->exec(dt);
+        else self->exec(dt);
+      }
+    };
+
+    // The handle of a caching call site: like SiteHandle, but the result of the last run is kept
+    // in the handle and constructed there in place.
+    template <MillisFunc millis, typename Stamp, typename Ret, typename Callback>
+    struct CachedSiteHandle: public LocalHandle<Stamp>, public CallbackSlot<Callback> {
+      Storage<Ret> last;
+      constexpr CachedSiteHandle() {}
+
+      bool started() const { return HandleBase::started(thunk); }
+      bool start(Callback &&f, uint32_t phase) {
+        if (!this->claim()) return false;
+        this->store(detail::move(f));
+        LocalHandle<Stamp>::start(thunk, initialStamp<millis>(*this, phase));
+        return true;
+      }
+
+      void exec(uint32_t dt) { MaybeFactory::emplace(last, this->callback(), dt); }
+      void run(uint32_t dt, uint32_t interval) {
+#if defined(EXEC_EVERY_STATS)
+        RunTiming timing(&this->stats, dt, interval);
+#elif defined(EXEC_EVERY_PROFILE)
+        RunTiming timing(nullptr, dt, interval);
+#else
+        (void)interval;
+#endif
+        exec(dt);
+      }
+      Cached<Ret> view(bool ran) { return MaybeFactory::cached<Ret>(this, &last, ran); }
+      static void thunk(HandleBase *h, Op op, void *out, uint32_t dt) {
+        CachedSiteHandle *self = static_cast<CachedSiteHandle*>(h);
+        uint32_t const interval = dt;
+        if (!control<millis>(*self, op, out, dt)) return;
+        if (op == Op::Exec) self->exec(dt);
+        else self->run(dt, interval);
+      }
+    };
+  } // namespace detail
+
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename Stamp = uint32_t, typename Policy = Relative,
+            typename RunCondition, typename ThrottleCondition, typename F>
+  inline auto every_if_throttled_impl(detail::Identity<Stamp> const interval, 
+                                      RunCondition &&runCondition, 
+                                      ThrottleCondition &&throttleCondition, 
+                                      F&& f, uint32_t const phase = detail::AutoPhase) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    
+    using Ret = decltype(detail::invoke(f, 0, 0));
+    using Callback = detail::DecayFunction<detail::BareType<F>>;
+
+    static detail::SiteHandle<millis, Stamp, Ret, Callback> handle;
+    if (!handle.started() && handle.start(Callback(detail::move(f)), detail::InitialCredit<Policy>::get(interval, phase)))
+      detail::identify<Tag, File>(handle);
+
+    uint32_t dt;
+    detail::Due const due = detail::due<millis, Policy>(handle, interval, runCondition, throttleCondition, dt);
+    if (due == detail::Due::Run) return handle.run(dt, interval);
+#ifdef EXEC_EVERY_STATS
+    if (due == detail::Due::Skipped) ++handle.stats.skipped;
+#endif
+    return detail::MaybeFactory::empty<Ret>(&handle);
+  }  
+
+  // Run as soon as the condition is met and a token is available; tokens accrue at one per 
+  // interval, up to Burst of them.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, unsigned Burst, typename C, typename F>
+  inline auto throttled_burst_impl(uint32_t const interval, C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    static_assert(Burst > 0, "exec_throttled_burst: burst must be at least 1");
+    return every_if_throttled_impl<Tag, File, millis, uint32_t, TokenBucket<Burst>>(interval, true, c, f);
+  }
+
+  // Caching variant: the result stays in the handle and a Cached<T> view is returned.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename Stamp = uint32_t,
+            typename RunCondition, typename ThrottleCondition, typename F>
+  inline auto every_if_throttled_cached_impl(detail::Identity<Stamp> const interval, 
+                                             RunCondition &&runCondition, 
+                                             ThrottleCondition &&throttleCondition, 
+                                             F&& f) -> Cached<decltype(detail::invoke(f, 0, 0))> {
+    
+    using Ret = decltype(detail::invoke(f, 0, 0));
+    using Callback = detail::DecayFunction<detail::BareType<F>>;
+    static_assert(!detail::IsSame<Ret, void>::value && !detail::IsReference<Ret>::value, 
+                  "exec_every_cached: the callback must return a value");
+
+    static detail::CachedSiteHandle<millis, Stamp, Ret, Callback> handle;
+    if (!handle.started() && handle.start(Callback(detail::move(f)), detail::phase(interval)))
+      detail::identify<Tag, File>(handle);
+
+    uint32_t dt;
+    detail::Due const due = detail::due<millis, Relative>(handle, interval, runCondition, throttleCondition, dt);
+    if (due == detail::Due::Run) {
+      handle.run(dt, interval);
+      return handle.view(true);
+    }
+#ifdef EXEC_EVERY_STATS
+    if (due == detail::Due::Skipped) ++handle.stats.skipped;
+#endif
+    return handle.view(false);
+  }
+
+  namespace detail {
+    // Callback of a downstream stage, bound to the value produced upstream.
+    template <typename F, typename V>
+    struct Stage {
+      F &f;
+      V &v;
+      auto operator()() -> decltype(f(v)) { return f(v); }
+    };
+
+    template <typename F>
+    struct Stage<F, void> {
+      F &f;
+      auto operator()() -> decltype(f()) { return f(); }
+    };
+
+    template <typename F, typename V> inline Stage<F, V> stage(F &f, V &v) { return Stage<F, V>{f, v}; }
+    template <typename F> inline Stage<F, void> stage(F &f) { return Stage<F, void>{f}; }
+  } // namespace detail
+
+  // Downstream stages: run f on the value of upstream if (and only if) upstream produced one on 
+  // this pass. A stage has no state of its own; the value is passed by reference.
+  template <typename T, typename F>
+  inline auto then_impl(Optional<T> &upstream, F&& f) -> Optional<decltype(f(upstream.value()))> {
+    using Ret = decltype(f(upstream.value()));
+    if (!upstream.valid()) return Optional<Ret>{};
+    return detail::RunAndReturn<Ret>::run(detail::stage(f, upstream.value()), 0);
+  }
+
+  template <typename T, typename F>
+  inline auto then_impl(Optional<T> const &upstream, F&& f) -> Optional<decltype(f(upstream.value()))> {
+    using Ret = decltype(f(upstream.value()));
+    if (!upstream.valid()) return Optional<Ret>{};
+    return detail::RunAndReturn<Ret>::run(detail::stage(f, upstream.value()), 0);
+  }
+
+  // Temporaries (e.g. the result of a call site used directly) live until the end of the stage.
+  template <typename T, typename F>
+  inline auto then_impl(Optional<T> &&upstream, F&& f) -> Optional<decltype(f(upstream.value()))> {
+    return then_impl(upstream, f);
+  }
+
+  template <typename F>
+  inline auto then_impl(Optional<void> const &upstream, F&& f) -> Optional<decltype(f())> {
+    using Ret = decltype(f());
+    if (!upstream.valid()) return Optional<Ret>{};
+    return detail::RunAndReturn<Ret>::run(detail::stage(f), 0);
+  }
+
+  template <typename T, typename F>
+  inline auto then_impl(Cached<T> const &upstream, F&& f) -> Optional<decltype(f(upstream.value()))> {
+    using Ret = decltype(f(upstream.value()));
+    if (!upstream.valid()) return Optional<Ret>{};
+    return detail::RunAndReturn<Ret>::run(detail::stage(f, upstream.value()), 0);
+  }
+
+  // Hint returned by the callback of an adaptive call site instead of a value to compare.
+  enum class Trend: uint8_t { Stable, Changed };
+
+  namespace detail {
+    // Change detection of adaptive call sites: compares each result with a copy of the previous 
+    // one. The copy is kept in raw storage so that the handle stays trivially destructible.
+    template <typename T>
+    struct Backoff {
+      alignas(T) unsigned char bytes[sizeof(T)];
+      bool has = false;
+      constexpr Backoff(): bytes{} {}
+
+      T &previous() { return *static_cast<T*>(static_cast<void*>(bytes)); }
+      bool changed(T const &value) {
+        if (has) {
+          if (previous() == value) return false;
+          previous().~T();
+        }
+        new (bytes) T(value);
+        has = true;
+        return true;
+      }
+      void reset() {
+        if (has) previous().~T();
+        has = false;
+      }
+    };
+
+    template <>
+    struct Backoff<Trend> {
+      bool changed(Trend const trend) { return trend == Trend::Changed; }
+      void reset() {}
+    };
+
+    // The handle of an adaptive call site; an interval of 0 stands for the minimum interval. 
+    // Resetting it also drops the interval back to the minimum and forgets the previous result.
+    template <MillisFunc millis, typename Ret, typename Callback>
+    struct AdaptiveHandle: public SiteHandle<millis, uint32_t, Ret, Callback> {
+      using Base = SiteHandle<millis, uint32_t, Ret, Callback>;
+      uint32_t interval = 0;
+      Backoff<Ret> backoff;
+      constexpr AdaptiveHandle() {}
+
+      bool started() const { return HandleBase::started(thunk); }
+      bool start(Callback &&f, uint32_t phase) {
+        if (!this->claim()) return false;
+        this->store(detail::move(f));
+        LocalHandle<uint32_t>::start(thunk, initialStamp<millis>(*this, phase));
+        return true;
+      }
+
+      static void thunk(HandleBase *h, Op op, void *out, uint32_t dt) {
+        if (op == Op::Reset) {
+          AdaptiveHandle *self = static_cast<AdaptiveHandle*>(h);
+          self->interval = 0;
+          self->backoff.reset();
+        }
+        Base::thunk(h, op, out, dt);
+      }
+    };
+  } // namespace detail
+
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename F>
+  inline auto every_adaptive_impl(uint32_t const minInterval, uint32_t const maxInterval, F&& f) 
+      -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    using Ret = decltype(detail::invoke(f, 0, 0));
+    using Callback = detail::DecayFunction<detail::BareType<F>>;
+    static_assert(!detail::IsSame<Ret, void>::value && !detail::IsReference<Ret>::value, 
+                  "exec_every_adaptive: the callback must return a value or an exec::Trend");
+
+    static detail::AdaptiveHandle<millis, Ret, Callback> handle;
+    if (!handle.started() && handle.start(Callback(detail::move(f)), detail::phase(minInterval)))
+      detail::identify<Tag, File>(handle);
+
+    uint32_t const interval = handle.interval ? handle.interval : minInterval;
+    uint32_t dt;
+    if (detail::due<millis, Relative>(handle, interval, true, true, dt) != detail::Due::Run) 
+      return detail::MaybeFactory::empty<Ret>(&handle);
+
+    Maybe<Ret> result = handle.run(dt, interval);
+    if (handle.backoff.changed(result.value())) handle.interval = minInterval;
+    else handle.interval = interval < maxInterval / 2 ? interval * 2 : maxInterval;
+    return result;
+  }
+
+#ifdef EXEC_EVERY_PROFILE
+  // The probe polls are taken out of the poll count, and the deadline they note is undone, so
+  // that calibrating does not affect the current pass.
+  inline void LoopProfiler::calibrate() {
+#ifdef EXEC_EVERY_DEADLINES
+    detail::Deadline<::millis> const deadline = detail::Deadline<::millis>::get();
+#endif
+    detail::Timer<uint32_t> timer(::millis());
+    uint32_t dt;
+    uint32_t const start = ::micros();
+    for (uint16_t i = 0; i != 256; ++i) 
+      detail::due<::millis, Relative>(timer, 0xffffffff, true, true, dt);
+    pollCost = (::micros() - start) * 1000 / 256;
+    polls -= 256;
+#ifdef EXEC_EVERY_DEADLINES
+    detail::Deadline<::millis>::get() = deadline;
+#endif
+  }
+#endif
+
+  // Compact variant: the call site only stores its timer (no callback, no thunk) and returns an
+  // Optional<T> instead of a Maybe<T>. As a consequence, getHandle(), reset() and force() are not
+  // available for these call sites.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename Stamp = uint32_t, typename Policy = Relative,
+            typename RunCondition, typename ThrottleCondition, typename F>
+  inline auto every_if_throttled_lite_impl(detail::Identity<Stamp> const interval, 
+                                           RunCondition &&runCondition, 
+                                           ThrottleCondition &&throttleCondition, 
+                                           F&& f) -> Optional<decltype(detail::invoke(f, 0, 0))> {
+    
+    using Ret = decltype(detail::invoke(f, 0, 0));
+    static detail::LiteTimer<Stamp> timer;
+#ifdef EXEC_EVERY_STAGGER
+    if (!timer.started) {
+      timer.reset(detail::now<millis>() - detail::phase(interval));
+      timer.started = true;
+    }
+#endif
+
+    uint32_t dt;
+    if (detail::due<millis, Policy>(timer, interval, runCondition, throttleCondition, dt) == detail::Due::Run) {
+#ifdef EXEC_EVERY_PROFILE
+      detail::RunTiming timing(nullptr, dt, interval);
+#endif
+      return detail::RunAndReturn<Ret>::run(f, dt);
+    }
+    return Optional<Ret>{};
+  }  
+
+  // Run at every interval regardless of any conditions.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename Stamp = uint32_t, typename Policy = Relative, typename F>
+  inline auto every_impl(detail::Identity<Stamp> const interval, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, Stamp, Policy>(interval, true, true, f);
+  }
+  
+  // Run at every interval, starting phase into the first period: the first run comes after
+  // interval - phase. Call sites with the same interval and different phases never share a pass.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename Stamp = uint32_t, typename F>
+  inline auto every_phased_impl(detail::Identity<Stamp> const interval, uint32_t const phase, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, Stamp>(interval, true, true, f, phase);
+  }
+
+  // Run only when the interval expires and the condition is met at that moment in time. If the interval
+  // expires and the condition is not met, the timer is reset and the condition is checked when it 
+  // expires again.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename Stamp = uint32_t, typename Policy = Relative, typename C, typename F>
+  inline auto every_if_impl(detail::Identity<Stamp> const interval, C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, Stamp, Policy>(interval, c, true, f);
+  }
+
+  // Run as soon as the interval has expired and the condition is met. If the condition is not met, 
+  // the timer keeps running and the condition is checked each subsequent time until it evaluates 
+  // to true.
+  template <int Tag, uint32_t File, detail::MillisFunc millis = ::millis, typename Stamp = uint32_t, typename C, typename F>
+  inline auto throttled_impl(detail::Identity<Stamp> const interval, C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, Stamp>(interval, true, c, f);
+  }  
+
+
+  namespace detail {
+    // Narrowest timestamp that can hold twice the interval, leaving a full interval of headroom
+    // for slow passes through loop() before the timestamp arithmetic wraps.
+    template <uint32_t Interval> 
+    using StampFor = Conditional<(Interval < 0x80u), uint8_t, Conditional<(Interval < 0x8000u), uint16_t, uint32_t>>;
+  }
+
+  // Compile-time intervals. The interval is a template parameter, which allows the comparison to
+  // be folded into a constant and the narrowest suitable timestamp type to be selected.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, uint32_t Interval, typename F>
+  inline auto every_ct_impl(F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, detail::StampFor<Interval>>(Interval, true, true, f);
+  }
+
+  template <int Tag, uint32_t File, detail::MillisFunc millis, uint32_t Interval, typename C, typename F>
+  inline auto every_if_ct_impl(C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, detail::StampFor<Interval>>(Interval, c, true, f);
+  }
+
+  // A throttled call site can stay expired for any length of time while its condition is false,
+  // which no headroom covers, so it keeps a full-width timestamp.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, uint32_t Interval, typename C, typename F>
+  inline auto throttled_ct_impl(C&& c, F&& f) -> Maybe<decltype(detail::invoke(f, 0, 0))> {
+    return every_if_throttled_impl<Tag, File, millis, uint32_t>(Interval, true, c, f);
+  }
+
+  // Contiguous run of batched samples.
+  template <typename T>
+  struct Span {
+    T const *data;
+    uint16_t size;
+    T const *begin() const { return data; }
+    T const *end() const   { return data + size; }
+  };
+
+  // View of the samples collected by an exec_every_batch call site since its previous batch, 
+  // oldest first. The samples live in the call site's ring buffer and are only valid inside 
+  // the batch callback.
+  template <typename T>
+  class Batch {
+    T const *items;
+    uint16_t capacity, start, count, lost;
+  public:
+    Batch(T const *items, uint16_t capacity, uint16_t start, uint16_t count, uint16_t lost): 
+      items(items), capacity(capacity), start(start), count(count), lost(lost) {}
+
+    uint16_t size() const    { return count; }
+    bool empty() const       { return count == 0; }
+    // Number of samples overwritten because more than the capacity was collected.
+    uint16_t dropped() const { return lost; }
+
+    T const &operator[](uint16_t i) const { 
+      uint16_t const j = start + i; 
+      return items[j >= capacity ? j - capacity : j]; 
+    }
+
+    // The samples as (at most) two contiguous runs; second() is empty unless samples were dropped.
+    Span<T> first() const  { return Span<T>{items + start, static_cast<uint16_t>(count < capacity - start ? count : capacity - start)}; }
+    Span<T> second() const { return Span<T>{items, static_cast<uint16_t>(count - first().size)}; }
+  };
+
+  namespace detail {
+    template <typename T, uint16_t N>
+    class Ring {
+      T items[N];
+      uint16_t head = 0, count = 0, lost = 0;
+    public:
+      void push(T&& item) {
+        items[head] = detail::move(item);
+        head = head + 1 == N ? 0 : head + 1;
+        if (count < N) ++count; else ++lost;
+      }
+      Batch<T> view() const { return Batch<T>(items, N, count < N ? 0 : head, count, lost); }
+      void clear() { head = count = lost = 0; }
+    };
+
+    template <typename F, typename B> inline auto invokeBatch(F&& f, B const &b, uint32_t const dt, int) -> decltype(f(b, dt)) { return f(b, dt); }
+    template <typename F, typename B> inline auto invokeBatch(F&& f, B const &b, uint32_t const, long)   -> decltype(f(b))     { return f(b);     }
+
+    // Callback of a batching call site: owns the ring buffer, hands it to the batch callback
+    // and empties it afterwards.
+    template <typename T, uint16_t N, typename Ret, typename Sample, typename Callback>
+    struct BatchCallback {
+      Sample sample;
+      Callback f;
+      Ring<T, N> ring;
+
+      BatchCallback(Sample sample, Callback f): sample(detail::move(sample)), f(detail::move(f)) {}
+      void collect() { ring.push(T(sample())); }
+
+      struct Clear {
+        Ring<T, N> &ring;
+        ~Clear() { ring.clear(); }
+      };
+      Ret operator()(uint32_t dt) {
+        Clear const clear{ring};
+        return invokeBatch(f, ring.view(), dt, 0);
+      }
+    };
+  } // namespace detail
+
+  // Call sample() on every pass and store its result in a ring buffer of N samples owned by the
+  // call site; when the interval expires, pass the collected samples to f as a Batch<T>.
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename T, uint16_t N, typename S, typename F>
+  inline auto every_batch_impl(uint32_t const interval, S&& sample, F&& f) 
+      -> Maybe<decltype(detail::invokeBatch(f, detail::declval<Batch<T>&>(), 0, 0))> {
+    static_assert(N > 0, "exec_every_batch: capacity must be at least 1");
+    using Ret = decltype(detail::invokeBatch(f, detail::declval<Batch<T>&>(), 0, 0));
+    using Callback = detail::BatchCallback<T, N, Ret, detail::DecayFunction<detail::BareType<S>>, 
+                                                      detail::DecayFunction<detail::BareType<F>>>;
+
+    static detail::SiteHandle<millis, uint32_t, Ret, Callback> handle;
+    if (!handle.started() && handle.start(Callback(detail::move(sample), detail::move(f)), detail::phase(interval)))
+      detail::identify<Tag, File>(handle);
+    handle.callback().collect();
+
+    uint32_t dt;
+    if (detail::due<millis, Relative>(handle, interval, true, true, dt) == detail::Due::Run) 
+      return handle.run(dt, interval);
+    return detail::MaybeFactory::empty<Ret>(&handle);
+  }
+
+  // Tasks: call sites whose callback may suspend and continue on a later pass, so that long work
+  // can be spread over several passes. A new instance is started when the interval has expired 
+  // (measured from the start of the previous instance) and the previous instance has finished.
+  
+  // State of a protothread task body, see exec_task_pt and the exec_pt_* macros.
+  struct Pt {
+    uint16_t line = 0;      // resume point
+    uint32_t sleepFor = 0;  // requested by exec_pt_sleep
+    uint32_t dt = 0;        // time since the previous instance was started
+    void sleep(uint32_t ms) { sleepFor = ms; }
+  };
+
+#ifdef EXEC_EVERY_COROUTINES
+  template <typename T = void> class Task;
+
+  namespace detail {
+    template <typename Ret, typename Callback> struct CoroutineRunner;
+
+    template <typename T>
+    struct TaskPromiseResult {
+      Optional<T> result;
+      void return_value(T value) { result = MaybeFactory::optional<T>(detail::move(value)); }
+      // Empty if the body exited through an exception instead of co_return.
+      Maybe<T> take(HandleBase *h) { 
+        if (!result.valid()) return MaybeFactory::empty<T>(h);
+        return MaybeFactory::value<T>(h, detail::move(result.value())); 
+      }
+    };
+
+    template <>
+    struct TaskPromiseResult<void> {
+      bool returned = false;
+      void return_void() { returned = true; }
+      Maybe<void> take(HandleBase *h) { return returned ? MaybeFactory::voidValue(h) : MaybeFactory::empty<void>(h); }
+    };
+
+    struct TaskSleep {
+      uint32_t ms;
+      bool await_ready() const noexcept { return false; }
+      template <typename P> void await_suspend(std::coroutine_handle<P> h) const noexcept { h.promise().sleepFor = ms; }
+      void await_resume() const noexcept {}
+    };
+  }
+
+  // Return type of a coroutine task body. The frame is allocated with operator new when the 
+  // instance starts and released when it finishes.
+  template <typename T>
+  class Task {
+  public:
+    using ValueType = T;
+
+    struct promise_type: public detail::TaskPromiseResult<T> {
+      uint32_t sleepFor = 0;
+      Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+      // An exception ends the instance without a result: it finishes with an empty Maybe.
+      void unhandled_exception() {}
+    };
+
+    Task() = default;
+    Task(Task&& other): h(other.h) { other.h = nullptr; }
+    Task &operator=(Task&& other) {
+      if (this != &other) { 
+        if (h) h.destroy();
+        h = other.h;
+        other.h = nullptr;
+      }
+      return *this;
+    }
+    ~Task() { if (h) h.destroy(); }
+
+  private:
+    template <typename, typename> friend struct detail::CoroutineRunner;
+    explicit Task(std::coroutine_handle<promise_type> h): h(h) {}
+    std::coroutine_handle<promise_type> h;
+  };
+
+  // Awaitables for task bodies: continue on the next pass, or once ms have elapsed.
+  inline detail::TaskSleep yield() { return detail::TaskSleep{0}; }
+  inline detail::TaskSleep sleep(uint32_t ms) { return detail::TaskSleep{ms}; }
+#endif
+
+  namespace detail {
+#ifdef EXEC_EVERY_COROUTINES
+    // Keeps the coroutine handle taken from the Task rather than the Task itself, so that the
+    // runner (and the static handle holding it) stays trivially destructible.
+    template <typename Ret, typename Callback>
+    struct CoroutineRunner: public CallbackSlot<Callback> {
+      using ResultType = Ret;
+      std::coroutine_handle<typename Task<Ret>::promise_type> task;
+      constexpr CoroutineRunner() {}
+
+      bool running() const { return task != nullptr; }
+      void start(uint32_t dt) { 
+        Task<Ret> instance = invoke(this->callback(), dt, 0);
+        task = instance.h;
+        instance.h = nullptr;
+      }
+      void cancel() { 
+        if (task) task.destroy();
+        task = nullptr;
+      }
+      bool resume() { 
+        task.resume(); 
+        return task.done(); 
+      }
+      uint32_t takeSleep() { 
+        uint32_t const ms = task.promise().sleepFor; 
+        task.promise().sleepFor = 0; 
+        return ms; 
+      }
+      Maybe<Ret> finish(HandleBase *h) {
+        Maybe<Ret> result = task.promise().take(h);
+        cancel();
+        return result;
+      }
+    };
+#endif
+
+    template <typename Callback>
+    struct ProtothreadRunner: public CallbackSlot<Callback> {
+      using ResultType = void;
+      Pt pt;
+      bool active = false;
+      constexpr ProtothreadRunner() {}
+
+      bool running() const { return active; }
+      void start(uint32_t dt) { 
+        pt = Pt{}; 
+        pt.dt = dt; 
+        active = true; 
+      }
+      void cancel() { active = false; }
+      bool resume() { 
+        bool const done = this->callback()(pt);
+        active = !done;
+        return done;
+      }
+      uint32_t takeSleep() { 
+        uint32_t const ms = pt.sleepFor; 
+        pt.sleepFor = 0; 
+        return ms; 
+      }
+      Maybe<void> finish(HandleBase *h) { return MaybeFactory::voidValue(h); }
+    };
+
+    // The handle of a task call site. The timer holds the start of the current (or last) instance.
+    // Scheduled starts and each slice are recorded in the statistics; only the first slice of an 
+    // instance carries its dt.
+    template <MillisFunc millis, typename Runner>
+    struct TaskHandle: public LocalHandle<uint32_t> {
+      using Ret = typename Runner::ResultType;
+      Runner runner;
+      uint32_t wakeAt = 0;
+      bool sleeping = false;
+
+      constexpr TaskHandle() {}
+
+      bool started() const { return HandleBase::started(thunk); }
+      template <typename Callback>
+      bool start(Callback &&f, uint32_t phase) {
+        if (!this->claim()) return false;
+        runner.store(detail::move(f));
+        LocalHandle<uint32_t>::start(thunk, initialStamp<millis>(*this, phase));
+        return true;
+      }
+      
+      Maybe<Ret> poll(uint32_t const interval) {
+        uint32_t dt = 0;
+        if (!runner.running()) {
+          if (due<millis, Relative>(*this, interval, true, true, dt) != Due::Run) 
+            return MaybeFactory::empty<Ret>(this);
+          runner.start(dt);
+          return step(dt, interval, true);
+        }
+        return step(0, interval, false);
+      }
+
+      // Start an instance if none is running, then run its next slice unless it is sleeping.
+      Maybe<Ret> kick(uint32_t const dt) {
+        bool const starting = !runner.running();
+        if (starting) runner.start(dt);
+        return step(dt, 0, starting);
+      }
+
+      Maybe<Ret> step(uint32_t dt, uint32_t interval, bool starting) {
+        uint32_t const t = now<millis>();
+        if (!starting && sleeping && static_cast<int32_t>(t - wakeAt) < 0) {
+#ifdef EXEC_EVERY_DEADLINES
+          Deadline<millis>::note(t, wakeAt - t);
+#endif
+          return MaybeFactory::empty<Ret>(this);
+        }
+        sleeping = false;
+        bool done;
+        {
+#if defined(EXEC_EVERY_STATS)
+          RunTiming timing(&this->stats, starting ? dt : interval, interval);
+#elif defined(EXEC_EVERY_PROFILE)
+          RunTiming timing(nullptr, dt, interval);
+#else
+          (void)dt; (void)interval;
+#endif
+          done = runner.resume();
+        }
+        if (done) return runner.finish(this);
+        uint32_t const ms = runner.takeSleep();
+        if (ms) {
+          wakeAt = t + ms;
+          sleeping = true;
+        }
+#ifdef EXEC_EVERY_DEADLINES
+        Deadline<millis>::note(t, ms);
+#endif
+        return MaybeFactory::empty<Ret>(this);
+      }
+
+      static void thunk(HandleBase *h, Op op, void *out, uint32_t dt) {
+        TaskHandle *self = static_cast<TaskHandle*>(h);
+        switch (op) {
+        case Op::Reset: 
+          self->runner.cancel();
+          self->sleeping = false;
+          self->reset(now<millis>()); 
+          break;
+        case Op::Exec: 
+          if (out) *static_cast<Maybe<Ret>*>(out) = self->kick(dt); 
+          else self->kick(dt);
+          break;
+        case Op::Run: {
+          uint32_t const t = now<millis>();
+          dt = self->dt(t);
+          self->reset(t);
+          self->kick(dt);
+          break;
+        }
+        default:
+          control<millis>(*self, op, out, dt);
+          break;
+        }
+      }
+    };
+  } // namespace detail
+
+#ifdef EXEC_EVERY_COROUTINES
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename F>
+  inline auto task_impl(uint32_t const interval, F&& f) -> Maybe<typename decltype(detail::invoke(f, 0, 0))::ValueType> {
+    using Ret = typename decltype(detail::invoke(f, 0, 0))::ValueType;
+    using Callback = detail::DecayFunction<detail::BareType<F>>;
+    static detail::TaskHandle<millis, detail::CoroutineRunner<Ret, Callback>> handle;
+    if (!handle.started() && handle.start(Callback(detail::move(f)), detail::phase(interval)))
+      detail::identify<Tag, File>(handle);
+    return handle.poll(interval);
+  }
+#endif
+
+  template <int Tag, uint32_t File, detail::MillisFunc millis, typename F>
+  inline Maybe<void> task_pt_impl(uint32_t const interval, F&& f) {
+    using Callback = detail::DecayFunction<detail::BareType<F>>;
+    static detail::TaskHandle<millis, detail::ProtothreadRunner<Callback>> handle;
+    if (!handle.started() && handle.start(Callback(detail::move(f)), detail::phase(interval)))
+      detail::identify<Tag, File>(handle);
+    return handle.poll(interval);
+  }
+
+  // Central scheduler for call sites that do not need to be polled individually. Registered call 
+  // sites are kept in a binary min-heap ordered by deadline, so run() costs O(1) when nothing is 
+  // due and O(k log N) when k call sites are due. Deadlines are anchored: after an overrun, 
+  // missed periods are skipped and the grid is restarted from the current time.
+  template <unsigned Capacity, detail::MillisFunc millis = ::millis>
+  class Scheduler {
+    static_assert(Capacity > 0 && Capacity < 0x10000u, "Scheduler capacity must be in [1, 65535]");
+
+    struct Entry {
+      Handle handle;
+      uint32_t deadline;
+      uint32_t interval;
+    };
+
+    Entry heap[Capacity];
+    uint16_t count = 0;
+
+    static bool before(Entry const &a, Entry const &b) {
+      return static_cast<int32_t>(a.deadline - b.deadline) < 0;
+    }
+
+    void siftUp(uint16_t i) {
+      Entry const e = heap[i];
+      while (i > 0) {
+        uint16_t const parent = (i - 1) / 2;
+        if (!before(e, heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+      }
+      heap[i] = e;
+    }
+
+    void siftDown(uint16_t i) {
+      Entry const e = heap[i];
+      while (true) {
+        uint16_t child = 2 * i + 1;
+        if (child >= count) break;
+        if (child + 1 < count && before(heap[child + 1], heap[child])) ++child;
+        if (!before(heap[child], e)) break;
+        heap[i] = heap[child];
+        i = child;
+      }
+      heap[i] = e;
+    }
+
+    int find(Handle h) const {
+      for (uint16_t i = 0; i != count; ++i) 
+        if (heap[i].handle == h) return i;
+      return -1;
+    }
+
+  public:
+    // Schedule a handle to be run every interval (at least 1) ticks, starting one interval from 
+    // now. Returns false if the scheduler is full.
+    bool add(Handle h, uint32_t interval) {
+      if (count == Capacity) return false;
+      if (interval == 0) interval = 1;
+      heap[count] = Entry{ h, detail::now<millis>() + interval - detail::phase(interval), interval };
+      siftUp(count++);
+      return true;
+    }
+
+    // Stop running a handle. Returns false if it was not scheduled.
+    bool remove(Handle h) {
+      int const i = find(h);
+      if (i < 0) return false;
+      heap[i] = heap[--count];
+      if (i < count) {
+        siftDown(i);
+        siftUp(i);
+      }
+      return true;
+    }
+
+    // Reset the handle and restart its interval from now.
+    void reset(Handle h) {
+      exec::reset(h);
+      int const i = find(h);
+      if (i < 0) return;
+      heap[i].deadline = detail::now<millis>() + heap[i].interval;
+      siftDown(i);
+    }
+
+    // Run all call sites that are due.
+    void run() {
+      uint32_t const now = detail::now<millis>();
+      while (count > 0 && static_cast<int32_t>(now - heap[0].deadline) >= 0) {
+        Entry &top = heap[0];
+        uint32_t const late = now - top.deadline;
+        top.deadline = (late < top.interval) ? top.deadline + top.interval : now + top.interval;
+        Handle const h = top.handle;
+        uint32_t const interval = top.interval;
+        siftDown(0);
+        h->dispatch(detail::Op::Run, nullptr, interval);
+      }
+#ifdef EXEC_EVERY_DEADLINES
+      if (count > 0) detail::Deadline<millis>::note(now, heap[0].deadline - now);
+#endif
+    }
+
+    bool empty() const { return count == 0; }
+    bool full() const { return count == Capacity; }
+    uint16_t size() const { return count; }
+
+    // Time until the earliest scheduled call site is due; 0xffffffff when nothing is scheduled.
+    uint32_t idleFor() const {
+      if (count == 0) return 0xffffffff;
+      int32_t const remaining = static_cast<int32_t>(heap[0].deadline - millis());
+      return remaining > 0 ? static_cast<uint32_t>(remaining) : 0;
+    }
+  };
+
+  // Register a call site with a scheduler. The handle is created and added to the scheduler the
+  // first time the call site is reached; afterwards this only returns the handle. While the 
+  // scheduler is full, the handle is not started and nullptr is returned; it is added on the 
+  // first pass that finds room.
+  template <int Tag, uint32_t File, unsigned Capacity, detail::MillisFunc millis, typename F>
+  inline Handle schedule_impl(Scheduler<Capacity, millis> &scheduler, uint32_t const interval, F&& f) {
+    using Ret = decltype(detail::invoke(f, 0, 0));
+    using Callback = detail::DecayFunction<detail::BareType<F>>;
+    using Base = detail::SiteHandle<millis, uint32_t, Ret, Callback>;
+
+    static Base handle;
+    if (!handle.started() && !scheduler.full() && handle.start(Callback(detail::move(f)), 0)) {
+      detail::identify<Tag, File>(handle);
+      scheduler.add(&handle, interval);
+    }
+    return handle.started() ? &handle : nullptr;
+  }
+
+  namespace detail {
+    // A slot of a TaskPool: a handle whose callback and interval are set at runtime. Slots are
+    // started (and registered) on first allocation and keep their thunk when freed, so a stale
+    // Handle to a free slot stays harmless.
+    template <MillisFunc millis, typename Callback>
+    struct PoolSlot: public LocalHandle<uint32_t>, public CallbackSlot<Callback> {
+      uint32_t interval;    // 0 while the slot is free
+      bool once;
+      bool running;
+      bool cancelled;
+
+      constexpr PoolSlot(): interval(0), once(false), running(false), cancelled(false) {}
+
+      void open(Callback &&f, uint32_t const interval, bool const once, uint32_t const phase) {
+        this->store(detail::move(f));
+        this->interval = interval ? interval : 1;
+        this->once = once;
+        cancelled = false;
+#ifdef EXEC_EVERY_STATS
+        this->stats = Stats{};
+#endif
+        uint32_t const t = now<millis>() - phase;
+        if (HandleBase::started(thunk)) this->reset(t);
+        else LocalHandle<uint32_t>::start(thunk, t);
+      }
+
+      // Free the slot, deferred until the callback returns when called from inside it.
+      void close() {
+        if (running) {
+          cancelled = true;
+          return;
+        }
+        interval = 0;
+        this->destroy();
+      }
+
+      void exec(uint32_t dt) {
+        running = true;
+        invoke(this->callback(), dt, 0);
+        running = false;
+        if (once || cancelled) close();
+      }
+
+      void run(uint32_t dt, uint32_t interval) {
+#if defined(EXEC_EVERY_STATS)
+        RunTiming timing(&this->stats, dt, interval);
+#elif defined(EXEC_EVERY_PROFILE)
+        RunTiming timing(nullptr, dt, interval);
+#else
+        (void)interval;
+#endif
+        exec(dt);
+      }
+
+      static void thunk(HandleBase *h, Op op, void *out, uint32_t dt) {
+        PoolSlot *self = static_cast<PoolSlot*>(h);
+        uint32_t const interval = dt;
+        if (!control<millis>(*self, op, out, dt) || !self->interval) return;
+        if (op == Op::Exec) self->exec(dt);
+        else self->run(dt, interval);
+      }
+    };
+  } // namespace detail
+
+  // Fixed-capacity pool of call sites created at runtime, e.g. one timeout per connection. Slots
+  // are part of the pool object (no allocation) and their handles work like those of any call
+  // site. Callback is the type of the stored callable: a function type such as void(uint32_t) 
+  // stores function pointers, a class type stores functors. All tasks are polled by run().
+  template <unsigned N, typename Callback, detail::MillisFunc millis = ::millis>
+  class TaskPool {
+    static_assert(N > 0 && N < 0x10000u, "TaskPool capacity must be in [1, 65535]");
+    using Slot = detail::PoolSlot<millis, detail::DecayFunction<Callback>>;
+
+    Slot slots[N];
+
+    Slot *find(Handle h) {
+      for (Slot &slot: slots) 
+        if (&slot == h && slot.interval && !slot.cancelled) return &slot;
+      return nullptr;
+    }
+
+    Handle open(detail::DecayFunction<Callback> &&f, uint32_t const interval, bool const once, uint32_t const phase) {
+      for (Slot &slot: slots) {
+        if (slot.interval) continue;
+        slot.open(detail::move(f), interval, once, phase);
+        return &slot;
+      }
+      return nullptr;
+    }
+
+  public:
+    // Run f every interval (at least 1) ticks, the first time interval - phase ticks from now 
+    // (phase is taken modulo the interval). Returns nullptr if the pool is full.
+    Handle every(uint32_t const interval, detail::DecayFunction<Callback> f, uint32_t const phase = 0) {
+      return open(detail::move(f), interval, false, detail::phase(interval, phase));
+    }
+
+    // Run f once, interval ticks from now, and free the slot. Returns nullptr if the pool is full.
+    Handle after(uint32_t const interval, detail::DecayFunction<Callback> f) {
+      return open(detail::move(f), interval, true, 0);
+    }
+
+    // Free the slot of a task (also from inside its own callback). Returns false if h is not an
+    // active task of this pool.
+    bool cancel(Handle h) {
+      Slot *slot = find(h);
+      if (!slot) return false;
+      slot->close();
+      return true;
+    }
+
+    bool active(Handle h) { return find(h) != nullptr; }
+
+    uint16_t size() const {
+      uint16_t n = 0;
+      for (Slot const &slot: slots) n += slot.interval && !slot.cancelled;
+      return n;
+    }
+    bool full() const { return size() == N; }
+
+    // Run all tasks that are due. Goes through the same expiry check as the polled call sites,
+    // so snapshots, deadlines and statistics apply.
+    void run() {
+      for (Slot &slot: slots) {
+        if (!slot.interval) continue;
+        uint32_t dt;
+        if (detail::due<millis, Relative>(slot, slot.interval, true, true, dt) == detail::Due::Run) 
+          slot.run(dt, slot.interval);
+      }
+    }
+  };
+
+  // Simulated clock for host-side tests. Use VirtualClock<>::millis as the clock of call sites
+  // (exec_every_with) or schedulers; time only moves when set() or advance() is called. Multiple
+  // independent clocks can be created by using different values for Id.
+  template <int Id = 0>
+  struct VirtualClock {
+    static uint32_t time;
+
+    static uint32_t millis() { return time; }
+    static void set(uint32_t t) { time = t; }
+    static void advance(uint32_t dt) { time += dt; }
+
+#ifdef EXEC_EVERY_DEADLINES
+    // Simulate until the given time. Each iteration takes a snapshot, calls pass() (which should
+    // poll the call sites and/or run the schedulers driven by this clock) and then jumps straight
+    // to the earliest deadline instead of stepping through every tick. When a call site is due
+    // immediately (e.g. a throttled call site waiting for its condition), the clock advances by 
+    // one tick. Returns the number of passes.
+    template <typename Pass>
+    static uint32_t runUntil(uint32_t const until, Pass&& pass) {
+      uint32_t passes = 0;
+      while (static_cast<int32_t>(until - time) > 0) {
+        tick<millis>();
+        pass();
+        ++passes;
+        uint32_t const idle = idleFor<millis>();
+        uint32_t const left = until - time;
+        advance(idle == 0 ? 1 : (idle < left ? idle : left));
+      }
+      release<millis>();
+      return passes;
+    }
+
+    // Simulate for the given duration from the current time.
+    template <typename Pass>
+    static uint32_t runFor(uint32_t const duration, Pass&& pass) {
+      return runUntil(time + duration, pass);
+    }
+#endif
+  };
+  template <int Id> uint32_t VirtualClock<Id>::time = 0;
+
+  // Clock backends that are cheaper to read than millis(). Each is a uint32_t() function that can
+  // be passed as the clock of the *_with macros, schedulers and tick(); intervals are then given
+  // in the unit of that clock.
+  namespace clocks {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+    // ARM Cortex-M3/M4/M7/M33 DWT cycle counter: one cycle resolution, one load. Wraps after
+    // 2^32 cycles (about 25 s at 168 MHz), so intervals must stay below half of that. Call 
+    // startCycles() once before use.
+    inline void startCycles() {
+      *reinterpret_cast<uint32_t volatile*>(0xE000EDFCu) |= 1u << 24;   // DEMCR.TRCENA
+      *reinterpret_cast<uint32_t volatile*>(0xE0001000u) |= 1u;         // DWT_CTRL.CYCCNTENA
+    }
+    inline uint32_t cycles() { return *reinterpret_cast<uint32_t volatile*>(0xE0001004u); }
+#endif
+
+#if defined(ARDUINO_ARCH_RP2040)
+    // RP2040 timer, low word read without latching the high word: one microsecond resolution, 
+    // one load. Wraps like micros(), after about 71 minutes.
+    inline uint32_t rp2040Micros() { return timer_hw->timerawl; }
+#endif
+
+#if defined(__AVR__)
+    // Timer0 overflows counted by the Arduino core: 1.024 ms resolution at 16 MHz (2.048 ms at 
+    // 8 MHz). Unlike millis(), the counter is read without masking interrupts; a read torn by
+    // the overflow interrupt is simply repeated.
+    inline uint32_t timer0Ticks() {
+      uint32_t ticks;
+      do ticks = timer0_overflow_count; while (ticks != timer0_overflow_count);
+      return ticks;
+    }
+
+    // Low byte of the overflow count, read with a single load. Only for 8 bit timestamps 
+    // (exec_every_stamp_with(uint8_t, ...)): intervals up to 127 ticks.
+    inline uint32_t timer0Ticks8() { return *reinterpret_cast<uint8_t volatile*>(&timer0_overflow_count); }
+#endif
+
+    // Time stored by the last call to tick<millis>(), without reading the clock or checking 
+    // whether a snapshot is active: a single load. tick() must be called on every pass (e.g. at 
+    // the top of loop()), otherwise time stands still for the call sites using this clock.
+    template <detail::MillisFunc millis = ::millis>
+    inline uint32_t lastTick() { return detail::Snapshot<millis>::get().now; }
+  } // namespace clocks
+
+} // namespace exec
+
+
+#ifndef __COUNTER__
+#define __COUNTER__ __LINE__
+#endif
+
+// Template tags of a call site, see exec::detail::fileId().
+#define EXEC_EVERY_TAG __COUNTER__, exec::detail::fileId(__FILE__, sizeof(__FILE__) - 1)
+
+#define exec_every_with(millisFunc, interval, ...) exec::every_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), __VA_ARGS__)
+#define exec_every_if_with(millisFunc, interval, condition, ...) exec::every_if_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), (condition), __VA_ARGS__)
+#define exec_throttled_with(millisFunc, interval, condition, ...) exec::throttled_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), (condition), __VA_ARGS__)
+
+#define exec_every(interval, ...) exec_every_with(::millis, (interval), __VA_ARGS__)
+#define exec_every_if(interval, condition, ...) exec_every_if_with(::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled(interval, condition, ...) exec_throttled_with(::millis, (interval), (condition), __VA_ARGS__)
+
+// Microsecond variants: interval and dt are in microseconds. Wraparound of micros() (~71.6 minutes)
+// is handled by unsigned subtraction, as long as the time between two runs stays below that.
+#define exec_every_us(interval, ...) exec_every_with(::micros, (interval), __VA_ARGS__)
+#define exec_every_if_us(interval, condition, ...) exec_every_if_with(::micros, (interval), (condition), __VA_ARGS__)
+#define exec_throttled_us(interval, condition, ...) exec_throttled_with(::micros, (interval), (condition), __VA_ARGS__)
+
+// Anchored (drift-free) variants: policy is one of exec::Resync, exec::Skip or exec::Burst<N>.
+#define exec_every_anchored_with(policy, millisFunc, interval, ...) exec::every_impl<EXEC_EVERY_TAG, (millisFunc), uint32_t, policy>((interval), __VA_ARGS__)
+#define exec_every_if_anchored_with(policy, millisFunc, interval, condition, ...) exec::every_if_impl<EXEC_EVERY_TAG, (millisFunc), uint32_t, policy>((interval), (condition), __VA_ARGS__)
+
+#define exec_every_anchored(policy, interval, ...) exec_every_anchored_with(policy, ::millis, (interval), __VA_ARGS__)
+#define exec_every_if_anchored(policy, interval, condition, ...) exec_every_if_anchored_with(policy, ::millis, (interval), (condition), __VA_ARGS__)
+
+#define exec_every_lite_with(millisFunc, interval, ...) exec::every_if_throttled_lite_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), true, true, __VA_ARGS__)
+#define exec_every_if_lite_with(millisFunc, interval, condition, ...) exec::every_if_throttled_lite_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), (condition), true, __VA_ARGS__)
+#define exec_throttled_lite_with(millisFunc, interval, condition, ...) exec::every_if_throttled_lite_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), true, (condition), __VA_ARGS__)
+
+#define exec_every_lite(interval, ...) exec_every_lite_with(::millis, (interval), __VA_ARGS__)
+#define exec_every_if_lite(interval, condition, ...) exec_every_if_lite_with(::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled_lite(interval, condition, ...) exec_throttled_lite_with(::millis, (interval), (condition), __VA_ARGS__)
+
+// Call sites with a narrower timestamp (uint8_t or uint16_t instead of uint32_t). The interval is
+// brace-initialized into the stamp type: a constant interval that does not fit is a compile error
+// and a non-constant interval of a wider type triggers -Wnarrowing. Intervals and the time between 
+// consecutive runs must stay below 2^N ticks (256 or 65536 ms for the millis() based versions).
+#define exec_every_stamp_with(Stamp, millisFunc, interval, ...) exec::every_impl<EXEC_EVERY_TAG, (millisFunc), Stamp>(Stamp{(interval)}, __VA_ARGS__)
+#define exec_every_if_stamp_with(Stamp, millisFunc, interval, condition, ...) exec::every_if_impl<EXEC_EVERY_TAG, (millisFunc), Stamp>(Stamp{(interval)}, (condition), __VA_ARGS__)
+#define exec_throttled_stamp_with(Stamp, millisFunc, interval, condition, ...) exec::throttled_impl<EXEC_EVERY_TAG, (millisFunc), Stamp>(Stamp{(interval)}, (condition), __VA_ARGS__)
+#define exec_every_lite_stamp_with(Stamp, millisFunc, interval, ...) exec::every_if_throttled_lite_impl<EXEC_EVERY_TAG, (millisFunc), Stamp>(Stamp{(interval)}, true, true, __VA_ARGS__)
+#define exec_every_if_lite_stamp_with(Stamp, millisFunc, interval, condition, ...) exec::every_if_throttled_lite_impl<EXEC_EVERY_TAG, (millisFunc), Stamp>(Stamp{(interval)}, (condition), true, __VA_ARGS__)
+#define exec_throttled_lite_stamp_with(Stamp, millisFunc, interval, condition, ...) exec::every_if_throttled_lite_impl<EXEC_EVERY_TAG, (millisFunc), Stamp>(Stamp{(interval)}, true, (condition), __VA_ARGS__)
+
+#define exec_every16(interval, ...) exec_every_stamp_with(uint16_t, ::millis, (interval), __VA_ARGS__)
+#define exec_every_if16(interval, condition, ...) exec_every_if_stamp_with(uint16_t, ::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled16(interval, condition, ...) exec_throttled_stamp_with(uint16_t, ::millis, (interval), (condition), __VA_ARGS__)
+#define exec_every_lite16(interval, ...) exec_every_lite_stamp_with(uint16_t, ::millis, (interval), __VA_ARGS__)
+#define exec_every_if_lite16(interval, condition, ...) exec_every_if_lite_stamp_with(uint16_t, ::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled_lite16(interval, condition, ...) exec_throttled_lite_stamp_with(uint16_t, ::millis, (interval), (condition), __VA_ARGS__)
+
+#define exec_every8(interval, ...) exec_every_stamp_with(uint8_t, ::millis, (interval), __VA_ARGS__)
+#define exec_every_if8(interval, condition, ...) exec_every_if_stamp_with(uint8_t, ::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled8(interval, condition, ...) exec_throttled_stamp_with(uint8_t, ::millis, (interval), (condition), __VA_ARGS__)
+#define exec_every_lite8(interval, ...) exec_every_lite_stamp_with(uint8_t, ::millis, (interval), __VA_ARGS__)
+#define exec_every_if_lite8(interval, condition, ...) exec_every_if_lite_stamp_with(uint8_t, ::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled_lite8(interval, condition, ...) exec_throttled_lite_stamp_with(uint8_t, ::millis, (interval), (condition), __VA_ARGS__)
+
+// Compile-time intervals: interval must be a constant expression.
+#define exec_every_ct_with(millisFunc, interval, ...) exec::every_ct_impl<EXEC_EVERY_TAG, (millisFunc), (interval)>(__VA_ARGS__)
+#define exec_every_if_ct_with(millisFunc, interval, condition, ...) exec::every_if_ct_impl<EXEC_EVERY_TAG, (millisFunc), (interval)>((condition), __VA_ARGS__)
+#define exec_throttled_ct_with(millisFunc, interval, condition, ...) exec::throttled_ct_impl<EXEC_EVERY_TAG, (millisFunc), (interval)>((condition), __VA_ARGS__)
+
+#define exec_every_ct(interval, ...) exec_every_ct_with(::millis, (interval), __VA_ARGS__)
+#define exec_every_if_ct(interval, condition, ...) exec_every_if_ct_with(::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled_ct(interval, condition, ...) exec_throttled_ct_with(::millis, (interval), (condition), __VA_ARGS__)
+
+// Run the callback when the trigger has been armed (e.g. from an ISR), at most once per interval.
+// Events arriving within the interval are coalesced into a single run.
+#define exec_on_event_with(millisFunc, trigger, interval, ...) exec_throttled_with(millisFunc, (interval), (trigger), __VA_ARGS__)
+#define exec_on_event(trigger, interval, ...) exec_on_event_with(::millis, (trigger), (interval), __VA_ARGS__)
+
+// Run the callback on the value of upstream (a Maybe<T>, Optional<T> or Cached<T>) on the passes
+// where upstream produced one. Stages can be chained: exec_then(exec_then(a, filter), publish).
+#define exec_then(upstream, ...) exec::then_impl((upstream), __VA_ARGS__)
+
+// Adaptive call sites: the interval doubles (up to maxInterval) each time the callback returns
+// the same value as before, and drops back to minInterval when the value changes. Callbacks can
+// also return exec::Trend to report the change themselves.
+#define exec_every_adaptive_with(millisFunc, minInterval, maxInterval, ...) exec::every_adaptive_impl<EXEC_EVERY_TAG, (millisFunc)>((minInterval), (maxInterval), __VA_ARGS__)
+#define exec_every_adaptive(minInterval, maxInterval, ...) exec_every_adaptive_with(::millis, (minInterval), (maxInterval), __VA_ARGS__)
+
+// Caching call sites: the last result is kept in the call site and an exec::Cached<T> view is 
+// returned, which also gives access to the last result on passes where the callback did not run.
+#define exec_every_cached_with(millisFunc, interval, ...) exec::every_if_throttled_cached_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), true, true, __VA_ARGS__)
+#define exec_every_if_cached_with(millisFunc, interval, condition, ...) exec::every_if_throttled_cached_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), (condition), true, __VA_ARGS__)
+#define exec_throttled_cached_with(millisFunc, interval, condition, ...) exec::every_if_throttled_cached_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), true, (condition), __VA_ARGS__)
+#define exec_every_cached(interval, ...) exec_every_cached_with(::millis, (interval), __VA_ARGS__)
+#define exec_every_if_cached(interval, condition, ...) exec_every_if_cached_with(::millis, (interval), (condition), __VA_ARGS__)
+#define exec_throttled_cached(interval, condition, ...) exec_throttled_cached_with(::millis, (interval), (condition), __VA_ARGS__)
+
+// Run the callback every interval, with an explicit phase offset (see also EXEC_EVERY_STAGGER).
+#define exec_every_phased_with(millisFunc, interval, phase, ...) exec::every_phased_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), (phase), __VA_ARGS__)
+#define exec_every_phased(interval, phase, ...) exec_every_phased_with(::millis, (interval), (phase), __VA_ARGS__)
+
+// Token-bucket throttle: like exec_throttled, but up to burst runs (a constant) can follow each 
+// other immediately; the long-term rate stays at one run per interval.
+#define exec_throttled_burst_with(millisFunc, interval, burst, condition, ...) exec::throttled_burst_impl<EXEC_EVERY_TAG, (millisFunc), (burst)>((interval), (condition), __VA_ARGS__)
+#define exec_throttled_burst(interval, burst, condition, ...) exec_throttled_burst_with(::millis, (interval), (burst), (condition), __VA_ARGS__)
+
+// Run the callback every interval, unless the pass has used up its share of the time budget for
+// this priority (see exec::budget()); a deferred run is retried on the next pass.
+#define exec_every_prio_with(millisFunc, priority, interval, ...) exec_throttled_with(millisFunc, (interval), exec::WithinBudget(priority), __VA_ARGS__)
+#define exec_every_prio(priority, interval, ...) exec_every_prio_with(::millis, (priority), (interval), __VA_ARGS__)
+
+// Run the callback every interval, but only on the given core (see EXEC_EVERY_MULTICORE).
+#define exec_every_on_with(millisFunc, core, interval, ...) exec_throttled_with(millisFunc, (interval), exec::OnCore(core), __VA_ARGS__)
+#define exec_every_on(core, interval, ...) exec_every_on_with(::millis, (core), (interval), __VA_ARGS__)
+
+// Scheduler front-end: registers the callback with the scheduler on the first pass and returns
+// its handle. The callback is run from scheduler.run().
+#define exec_schedule(scheduler, interval, ...) exec::schedule_impl<EXEC_EVERY_TAG>((scheduler), (interval), __VA_ARGS__)
+
+// Batching: sample every pass into a ring buffer of N elements of type T, and pass the samples
+// to the callback as an exec::Batch<T> when the interval expires.
+#define exec_every_batch_with(millisFunc, T, N, interval, sample, ...) exec::every_batch_impl<EXEC_EVERY_TAG, (millisFunc), T, (N)>((interval), (sample), __VA_ARGS__)
+#define exec_every_batch(T, N, interval, sample, ...) exec_every_batch_with(::millis, T, (N), (interval), (sample), __VA_ARGS__)
+
+// Tasks: the callback may suspend and continue on a later pass. exec_task takes a C++20 coroutine
+// returning exec::Task<T>; exec_task_pt takes a protothread body bool(exec::Pt&) written with the
+// exec_pt_* macros below. Both return a Maybe<T> that holds the result when an instance finishes.
+#define exec_task_with(millisFunc, interval, ...) exec::task_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), __VA_ARGS__)
+#define exec_task(interval, ...) exec_task_with(::millis, (interval), __VA_ARGS__)
+#define exec_task_pt_with(millisFunc, interval, ...) exec::task_pt_impl<EXEC_EVERY_TAG, (millisFunc)>((interval), __VA_ARGS__)
+#define exec_task_pt(interval, ...) exec_task_pt_with(::millis, (interval), __VA_ARGS__)
+
+// Protothread body: local variables do not survive a suspension (use static or captured state),
+// and at most one suspension point may appear on a single line.
+#define exec_pt_begin(pt) switch ((pt).line) { case 0:
+#define exec_pt_yield(pt) do { (pt).line = __LINE__; return false; case __LINE__:; } while (0)
+#define exec_pt_sleep(pt, ms) do { (pt).sleep(ms); exec_pt_yield(pt); } while (0)
+#define exec_pt_wait_until(pt, condition) do { (pt).line = __LINE__; if (0) { case __LINE__:; } if (!(condition)) return false; } while (0)
+#define exec_pt_end(pt) } (pt).line = 0; return true